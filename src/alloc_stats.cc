@@ -0,0 +1,36 @@
+#include <stdlib.h>
+#include <new>
+
+#include "alloc_stats.h"
+
+#if COUNT_ALLOCS
+
+static thread_local long tAllocCount = 0;
+
+// The array and nothrow forms forward to these two
+void *operator new(size_t size)
+{
+    tAllocCount++;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+long threadAllocCount()
+{
+    return tAllocCount;
+}
+
+#else
+
+long threadAllocCount()
+{
+    return 0;
+}
+
+#endif
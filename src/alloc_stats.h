@@ -0,0 +1,10 @@
+#ifndef _ALLOC_STATS_H_
+#define _ALLOC_STATS_H_
+
+#include "config.h"
+
+// Heap allocations made so far by the calling thread. Only counted in
+// builds with COUNT_ALLOCS, otherwise always 0.
+long threadAllocCount();
+
+#endif /* include guard */
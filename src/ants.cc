@@ -3,6 +3,10 @@
 #include <cmath>
 #include <iomanip>
 #include <set>
+#include <atomic>
+#include <limits>
+#include <stdint.h>
+#include <string.h>
 
 #include "ants.h"
 #include "score.h"
@@ -11,8 +15,10 @@
 #include "omp.h"
 #include "jrng.h"
 #include "config.h"
+#include "alloc_stats.h"
 
 Ants::Ants(const Spec& spec,
+           const Dists& dists,
            const long popSize,
            const long maxStag,
            const float alpha,
@@ -20,194 +26,1391 @@ Ants::Ants(const Spec& spec,
            const float pers,
            const float minPhero,
            const int nbhoodDiv,
+           const int granularity,
+           const float eliteShare,
+           const float eliteGap,
+           const Intra_Mode intraMode,
+           const int memoSlots,
+           const int heldKarp,
            std::stringstream& dataStream,
            const long timeLimSec)
     : mySpec(spec), myPopSize(popSize), myMaxStag(maxStag),
       myAlpha(alpha), myBeta(beta), myPers(pers), myMinPhero(minPhero),
-      myNBHood(spec.getDim() / nbhoodDiv),
+      myNBHood(spec.getDim() / nbhoodDiv), myGranularity(granularity),
+      myEliteShare(eliteShare), myEliteGap(eliteGap), myIntraMode(intraMode),
+      myHeldKarp(std::min(heldKarp, ACO_HELD_KARP_MAX)),
+      myRouteTasks(omp_get_max_threads() > 1 &&
+                   (spec.getDim() >= ACO_TASK_MIN_DIM || popSize < omp_get_max_threads())),
+      myRouteMemo(spec.getDim(), memoSlots),
+      myIslands(NULL), myIsland(0), myShared(NULL),
+      myCheckpointSec(DEFAULT_CHECKPOINT_SEC), myResume(false), myWriter(NULL),
       myStream(dataStream), myTimeLimSec(timeLimSec),
-      myNodes(spec.getNodes()), myDim(spec.getDim()), myVCap(spec.getVCap())
+      myNodes(spec.getNodes()), myDim(spec.getDim()), myVCap(spec.getVCap()),
+      myDists(dists)
 {
-    this->myDists  = Score::makeScoreCache(this->myNodes, Score::real);
-    Savings::Savings S = Savings::makeSavings(this->myDists);
-    for (int i = 0; i < S.size(); i++)
-        myTrails.emplace_back(S[i].n1, S[i].n2, S[i].gain);
+    // Sparse distances can't afford all N^2 pairs
+    const int nGranular = granularity > 0 ? granularity :
+                          this->myDists.isSparse() ? this->myDists.getNbrCount() : 0;
+    Savings::Savings S = nGranular > 0 ?
+                         Savings::makeGranularSavings(this->myDists, nGranular) :
+                         Savings::makeSavings(this->myDists);
+    msg("Savings: %lu (%s)\n", S.size(), nGranular > 0 ? "granular" : "all pairs");
+    this->myTrails.swap(S);
+
+    this->myPhero = Floats(this->myTrails.size(), DEFAULT_ACO_PHEROMONE);
+    this->myGainAttr = Floats(this->myTrails.size());
+    for (int i = 0; i < this->myTrails.size(); i++)
+        this->myGainAttr[i] = pow(this->myTrails[i].gain, this->myAlpha);
+
+    this->myAttrFront = 0;
+    updateAttr();
+
+    // Index trails by node so a node's trails can be found without a scan
+    this->myNodeTrailStart = Ints(this->myDim + 1, 0);
+    for (const Trail& t : this->myTrails)
+    {
+        this->myNodeTrailStart[t.n1 + 1]++;
+        this->myNodeTrailStart[t.n2 + 1]++;
+    }
+    for (int i = 0; i < this->myDim; i++)
+        this->myNodeTrailStart[i + 1] += this->myNodeTrailStart[i];
+    this->myNodeTrails = Ints(this->myNodeTrailStart[this->myDim]);
+    Ints fill(this->myNodeTrailStart.begin(), this->myNodeTrailStart.end() - 1);
+    for (int i = 0; i < this->myTrails.size(); i++)
+    {
+        this->myNodeTrails[fill[this->myTrails[i].n1]++] = i;
+        this->myNodeTrails[fill[this->myTrails[i].n2]++] = i;
+    }
+
+    this->myEdgeTrails = this->myNodeTrails;
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int n = 0; n < this->myDim; n++)
+    {
+        std::sort(this->myEdgeTrails.begin() + this->myNodeTrailStart[n],
+                  this->myEdgeTrails.begin() + this->myNodeTrailStart[n + 1],
+                  [this, n](const int a, const int b)
+        {
+            const Trail &ta = this->myTrails[a], &tb = this->myTrails[b];
+            return (ta.n1 == n ? ta.n2 : ta.n1) < (tb.n1 == n ? tb.n2 : tb.n1);
+        });
+    }
 }
 
-inline void Ants::applyOneExchange(Paths& paths)
+// Trail joining a and b, or -1 if that saving was not kept
+inline int Ants::findTrail(const int a, const int b) const
 {
-    bool improved = true;
+    const int *first = &this->myEdgeTrails[0] + this->myNodeTrailStart[a];
+    const int *last = &this->myEdgeTrails[0] + this->myNodeTrailStart[a + 1];
+    const int *it = std::lower_bound(first, last, b, [this, a](const int t, const int other)
+    {
+        const Trail& tr = this->myTrails[t];
+        return (tr.n1 == a ? tr.n2 : tr.n1) < other;
+    });
+
+    if (it == last)
+        return -1;
+    const Trail& tr = this->myTrails[*it];
+    return (tr.n1 == a ? tr.n2 : tr.n1) == b ? *it : -1;
+}
+
+// Sampling weight of every trail, into both buffers. Pheromones only
+// change between iterations, so this is shared read-only by all ants.
+inline void Ants::updateAttr()
+{
+    Floats& front = this->myAttr[this->myAttrFront];
+    front = Floats(this->myTrails.size());
 
-    int itr = 0;
-    while (improved)
+    #pragma omp simd
+    for (int i = 0; i < this->myTrails.size(); i++)
+        front[i] = attr(i);
+
+    this->myAttr[1 - this->myAttrFront] = front;
+}
+
+inline float Ants::attr(const int i) const
+{
+    return this->myGainAttr[i] * pow(this->myPhero[i], this->myBeta);
+}
+
+// A local search move is only taken if it saves a set share of the edges
+// it removes. Rounding then cannot make two moves undo each other forever,
+// whatever the scale of the coordinates.
+inline bool Ants::isGain(const float gain, const float removed)
+{
+    return gain > ACO_MIN_GAIN * removed;
+}
+
+// Pheromone update of trails [lo, hi), into the back sampling weights.
+// Evaporation is one pass over flat arrays; the best route's trails
+// (sorted ids in taken) then get their deposited values on top.
+inline void Ants::updatePheromones(const int lo, const int hi, const bool reset,
+                                   const Ints& taken, const Floats& deposits,
+                                   float& minPhero, int& nAtMin)
+{
+    float *phero = this->myPhero.data();
+    const float *gainAttr = this->myGainAttr.data();
+    float *backAttr = this->myAttr[1 - this->myAttrFront].data();
+    const float pers = this->myPers, floor = this->myMinPhero;
+
+    if (reset)
+        std::fill(phero + lo, phero + hi, DEFAULT_ACO_PHEROMONE);
+    else
     {
-        improved = false;
+        #pragma omp simd
+        for (int i = lo; i < hi; i++)
+            phero[i] = std::max(pers * phero[i], floor);
+    }
+
+    for (int k = std::lower_bound(taken.begin(), taken.end(), lo) - taken.begin();
+            k < taken.size() && taken[k] < hi; k++)
+        phero[taken[k]] = deposits[k];
 
-        for (int i = 0; i < paths.size(); i++)
+    float minP = std::numeric_limits<float>::max();
+    int atMin = 0;
+    if (this->myBeta == 1.0f)
+    {
+        #pragma omp simd reduction(min: minP) reduction(+: atMin)
+        for (int i = lo; i < hi; i++)
+        {
+            backAttr[i] = gainAttr[i] * phero[i];
+            minP = std::min(minP, phero[i]);
+            atMin += fabsf(phero[i] - floor) < 0.01f;
+        }
+    }
+    else
+    {
+        for (int i = lo; i < hi; i++)
         {
-            Path& path1 = paths[i];
-            Ints& path1Hops = path1.hops;
+            backAttr[i] = gainAttr[i] * powf(phero[i], this->myBeta);
+            minP = std::min(minP, phero[i]);
+            atMin += fabsf(phero[i] - floor) < 0.01f;
+        }
+    }
+
+    minPhero = minP;
+    nAtMin = atMin;
+}
+
+// Gain of move m with the routes as they stand, 0 if it no longer gains
+// anything, and which route it would overload, if any, and the load that
+// route would need to come down to
+inline void Ants::priceMove(const Paths& paths, Move& m, const Scratch& scratch)
+{
+    m.gain = 0.0f;
+    m.full = -1;
+    const int i = scratch.routeOf[m.u], k = scratch.routeOf[m.v];
+    if (i == k)
+        return;
+
+    const Path &path1 = paths[i], &path2 = paths[k];
+    const Ints &hops1 = path1.hops, &hops2 = path2.hops;
+    const Floats &load1 = scratch.prefLoad[i], &load2 = scratch.prefLoad[k];
+    const int u = m.u, v = m.v, j = scratch.pos[u], jv = scratch.pos[v];
+    const int uPrev = hops1[j - 1], uNext = hops1[j + 1];
+    const int vPrev = hops2[jv - 1], vNext = hops2[jv + 1];
+    const float zu = this->myNodes[u].z, zv = this->myNodes[v].z;
+    float gain, removed, newLoad1 = path1.load, newLoad2 = path2.load;
+
+    switch (m.kind)
+    {
+    case MOVE_RELOCATE:
+    {
+        // u just after v, or just before it
+        const int at = jv + m.len1;
+        const int a = hops2[at - 1], b = hops2[at];
+        removed = this->myDists[uPrev][u] + this->myDists[u][uNext] + this->myDists[a][b];
+        gain = removed - this->myDists[uPrev][uNext] - this->myDists[a][u] - this->myDists[u][b];
+        newLoad1 -= zu;
+        newLoad2 += zu;
+        break;
+    }
+    case MOVE_TWO_OPT_STAR:
+        // path1 becomes hops1[.. j] + hops2[jv ..], and path2
+        // becomes hops2[.. jv - 1] + hops1[j + 1 ..]
+        removed = this->myDists[u][uNext] + this->myDists[vPrev][v];
+        gain = removed - this->myDists[u][v] - this->myDists[vPrev][uNext];
+        newLoad1 = load1[j] + (load2.back() - load2[jv - 1]);
+        newLoad2 = load2[jv - 1] + (load1.back() - load1[j]);
+        break;
+    case MOVE_EXCHANGE:
+        removed = this->myDists[uPrev][u] + this->myDists[u][uNext] +
+                  this->myDists[vPrev][v] + this->myDists[v][vNext];
+        gain = removed - this->myDists[uPrev][v] - this->myDists[v][uNext]
+               - this->myDists[vPrev][u] - this->myDists[u][vNext];
+        newLoad1 += zv - zu;
+        newLoad2 += zu - zv;
+        break;
+    case MOVE_CROSS:
+    {
+        // hops1[j, i2] and hops2[j1, j2], the latter starting right after
+        // v so that v is followed by u. The segments' own lengths cancel
+        // out of the gain.
+        const int i2 = j + m.len1 - 1, j1 = jv + 1, j2 = j1 + m.len2 - 1;
+        if (i2 >= (int) hops1.size() - 1 || j2 >= (int) hops2.size() - 1)
+            return;
+
+        const int uLast = hops1[i2], uAfter = hops1[i2 + 1];
+        const int b1 = hops2[j1], bLast = hops2[j2], bAfter = hops2[j2 + 1];
+        removed = this->myDists[uPrev][u] + this->myDists[uLast][uAfter] +
+                  this->myDists[v][b1] + this->myDists[bLast][bAfter];
+        gain = removed - this->myDists[uPrev][b1] - this->myDists[bLast][uAfter]
+               - this->myDists[v][u] - this->myDists[uLast][bAfter];
+
+        const float segLoad1 = load1[i2] - load1[j - 1];
+        const float segLoad2 = load2[j2] - load2[j1 - 1];
+        newLoad1 += segLoad2 - segLoad1;
+        newLoad2 += segLoad1 - segLoad2;
+        break;
+    }
+    default:
+        die("Unknown move: %s\n", Move_Kind_String[m.kind]);
+    }
+
+    if (!isGain(gain, removed))
+        return;
+
+    m.gain = gain;
+    if (newLoad1 > this->myVCap)
+    {
+        m.full = i;
+        m.fitLoad = path1.load - (newLoad1 - this->myVCap);
+    }
+    else if (newLoad2 > this->myVCap)
+    {
+        m.full = k;
+        m.fitLoad = path2.load - (newLoad2 - this->myVCap);
+    }
+}
+
+// Onto the heap, or set aside until its full route has room for it
+inline void Ants::queueMove(const Move& m, Scratch& scratch)
+{
+    if (m.full >= 0)
+        scratch.parked[m.full].push_back(m);
+    else
+    {
+        scratch.moves.push_back(m);
+        std::push_heap(scratch.moves.begin(), scratch.moves.end());
+    }
+}
+
+// Least distance between a point of one box and a point of the other
+inline float Ants::boxGap(const RouteBox& a, const RouteBox& b)
+{
+    const float gapX = std::max(0.0f, std::max(a.minX - b.maxX, b.minX - a.maxX));
+    const float gapY = std::max(0.0f, std::max(a.minY - b.maxY, b.minY - a.maxY));
+    return sqrtf(gapX * gapX + gapY * gapY);
+}
 
-            for (int j = 1; j < paths[i].hops.size() - 1; j++)
+// Every move that puts customer u next to v, a nearest neighbour of it
+// in another route, as far as the edges it would cut allow. The
+// candidates share most of their edges, so they are screened here
+// together and only the ones that gain are priced in full. via is
+// whichever of the two had the other in its neighbour list.
+inline void Ants::evalPair(const Paths& paths, const int u, const int v, const int via,
+                           Scratch& scratch)
+{
+    const int i = scratch.routeOf[u], k = scratch.routeOf[v];
+    if (i == k)
+        return;
+
+    const Ints &hops1 = paths[i].hops, &hops2 = paths[k].hops;
+    const int j = scratch.pos[u], jv = scratch.pos[v];
+    const int uPrev = hops1[j - 1], uNext = hops1[j + 1];
+    const int vPrev = hops2[jv - 1], vNext = hops2[jv + 1];
+    const float dIn = this->myDists[uPrev][u], dOut = this->myDists[u][uNext];
+    const float dvIn = this->myDists[vPrev][v], dvOut = this->myDists[v][vNext];
+    const float duv = this->myDists[u][v];
+    const float removeGain = dIn + dOut - this->myDists[uPrev][uNext];
+
+    Move m;
+    m.u = u;
+    m.v = v;
+    m.via = via;
+    m.epoch = scratch.epoch;
+    auto offer = [&](const Move_Kind kind, const int len1, const int len2)
+    {
+        m.kind = kind;
+        m.len1 = len1;
+        m.len2 = len2;
+        priceMove(paths, m, scratch);
+        if (m.gain > 0.0f)
+            queueMove(m, scratch);
+    };
+
+    // Relocate u just after v, or just before it
+    if (duv < removeGain)
+    {
+        if (isGain(removeGain - duv - this->myDists[u][vNext] + dvOut, dIn + dOut + dvOut))
+            offer(MOVE_RELOCATE, 1, 0);
+        if (isGain(removeGain - this->myDists[vPrev][u] - duv + dvIn, dIn + dOut + dvIn))
+            offer(MOVE_RELOCATE, 0, 0);
+    }
+
+    // 2-opt*: u followed by v
+    if (duv < dOut && isGain(dOut + dvIn - duv - this->myDists[vPrev][uNext], dOut + dvIn))
+        offer(MOVE_TWO_OPT_STAR, 0, 0);
+
+    // 1-exchange: u and v trade places. Each of the four new edges joins
+    // a customer to a customer of the other route, no nearer than the gap
+    // between their boxes, or to the depot, no nearer than the depot is
+    // to the customer's own box. Routes far apart are ruled out on that
+    // before any of the new edges is looked up.
+    if (duv < std::max(dIn, dOut))
+    {
+        const float removed = dIn + dOut + dvIn + dvOut;
+        const RouteBox &box1 = scratch.boxes[i], &box2 = scratch.boxes[k];
+        const float gap = boxGap(box1, box2);
+        if (removed > 2 * (std::min(gap, box1.depotGap) + std::min(gap, box2.depotGap)))
+        {
+            const float added = this->myDists[uPrev][v] + this->myDists[v][uNext] +
+                                this->myDists[vPrev][u] + this->myDists[u][vNext];
+            if (isGain(removed - added, removed))
+                offer(MOVE_EXCHANGE, 0, 0);
+        }
+    }
+
+    // CROSS-exchange: a segment from u and one from right after v, so
+    // that v is followed by u. One for one is left to 1-exchange.
+    const int j1 = jv + 1;
+    if (duv < dIn && j1 < (int) hops2.size() - 1)
+    {
+        const int n1 = std::min(ACO_OR_OPT_LEN, (int) hops1.size() - 1 - j);
+        const int n2 = std::min(ACO_OR_OPT_LEN, (int) hops2.size() - 1 - j1);
+        const float removedBoth = dIn + dvOut;
+        const float addedBoth = duv + this->myDists[uPrev][vNext];
+        float cut2[ACO_OR_OPT_LEN];
+        for (int len2 = 1; len2 <= n2; len2++)
+            cut2[len2 - 1] = this->myDists[hops2[j1 + len2 - 1]][hops2[j1 + len2]];
+
+        for (int len1 = 1; len1 <= n1; len1++)
+        {
+            const int uLast = hops1[j + len1 - 1], uAfter = hops1[j + len1];
+            const float cut1 = this->myDists[uLast][uAfter];
+            for (int len2 = 1; len2 <= n2; len2++)
             {
-                for (int k = 0; k < paths.size(); k++)
-                {
-                    if (k == i)
-                        continue;
+                if (len1 + len2 == 2)
+                    continue;
+
+                const int bLast = hops2[j1 + len2 - 1], bAfter = hops2[j1 + len2];
+                const float removed = removedBoth + cut1 + cut2[len2 - 1];
+                const float gain = removed - addedBoth - this->myDists[bLast][uAfter]
+                                   - this->myDists[uLast][bAfter];
+                if (isGain(gain, removed))
+                    offer(MOVE_CROSS, len1, len2);
+            }
+        }
+    }
+}
+
+// Pairs of each customer of route r with its nearest neighbours in other
+// routes that are within its reach. Once all of a customer's pairs have
+// been priced again, the moves queued for them before are out of date.
+inline void Ants::evalRoute(const Paths& paths, const int r, Scratch& scratch)
+{
+    const Ints& hops = paths[r].hops;
+    const int K = this->myDists.getNbrCount();
+
+    for (int j = 1; j < (int) hops.size() - 1; j++)
+    {
+        const int c = hops[j];
+        const int *nbrs = this->myDists.getNbrs(c);
+        const float *nbrDists = this->myDists.getNbrDists(c);
+        scratch.evalEpoch[c] = scratch.epoch;
+
+        for (int n = 0; n < K && nbrDists[n] < scratch.reach[c]; n++)
+        {
+            // Customers of routes not being searched have no route
+            const int v = nbrs[n];
+            if (scratch.routeOf[v] != r && scratch.routeOf[v] >= 0)
+                evalPair(paths, c, v, c, scratch);
+        }
+    }
+}
+
+// Carry out move m
+inline void Ants::applyMove(Paths& paths, const Move& m, Scratch& scratch)
+{
+    const int r1 = scratch.routeOf[m.u], r2 = scratch.routeOf[m.v];
+    Ints &hops1 = paths[r1].hops, &hops2 = paths[r2].hops;
+    const int j = scratch.pos[m.u], jv = scratch.pos[m.v];
+
+    switch (m.kind)
+    {
+    case MOVE_RELOCATE:
+        hops1.erase(hops1.begin() + j);
+        hops2.insert(hops2.begin() + jv + m.len1, m.u);
+        break;
+    case MOVE_TWO_OPT_STAR:
+        scratch.segA.assign(hops1.begin() + j + 1, hops1.end());
+        hops1.erase(hops1.begin() + j + 1, hops1.end());
+        hops1.insert(hops1.end(), hops2.begin() + jv, hops2.end());
+        hops2.erase(hops2.begin() + jv, hops2.end());
+        hops2.insert(hops2.end(), scratch.segA.begin(), scratch.segA.end());
+        break;
+    case MOVE_EXCHANGE:
+        hops1[j] = m.v;
+        hops2[jv] = m.u;
+        break;
+    case MOVE_CROSS:
+        scratch.segA.assign(hops1.begin() + j, hops1.begin() + j + m.len1);
+        scratch.segB.assign(hops2.begin() + jv + 1, hops2.begin() + jv + 1 + m.len2);
+        hops1.erase(hops1.begin() + j, hops1.begin() + j + m.len1);
+        hops1.insert(hops1.begin() + j, scratch.segB.begin(), scratch.segB.end());
+        hops2.erase(hops2.begin() + jv + 1, hops2.begin() + jv + 1 + m.len2);
+        hops2.insert(hops2.begin() + jv + 1, scratch.segA.begin(), scratch.segA.end());
+        break;
+    default:
+        die("Unknown move: %s\n", Move_Kind_String[m.kind]);
+    }
+
+    indexRoute(paths[r1], r1, scratch);
+    indexRoute(paths[r2], r2, scratch);
+}
+
+// Inter-route search over static move descriptors, in rounds. A round
+// prices every customer and nearest neighbour pair in different routes
+// for the routes it starts with, and the improving moves wait in a heap.
+// The best is priced again when it comes out, as the routes may have
+// changed since: if it now gains less it goes back in line, if it does
+// not fit it waits for its full route to shed enough load, and otherwise
+// it is applied. The routes a round changed are the only ones the next
+// round prices afresh, and their customers' older moves are dropped
+// unpriced, so the search does no work on routes that settled.
+inline bool Ants::improveRoutes(Paths& paths, Scratch& scratch)
+{
+    indexRoutes(paths, scratch);
+    scratch.moves.clear();
+    scratch.epoch = 0;
+    scratch.evalEpoch.assign(this->myDim, 0);
+    // Never shrunk, so the lists keep their capacity
+    if (scratch.parked.size() < paths.size())
+    {
+        scratch.parked.resize(paths.size());
+        scratch.isDirty.resize(paths.size(), false);
+    }
+    for (int r = 0; r < paths.size(); r++)
+    {
+        scratch.parked[r].clear();
+        markDirty(r, scratch);
+    }
+
+    return drainMoves(paths, scratch);
+}
+
+// Route r is to be priced afresh in the next round
+inline void Ants::markDirty(const int r, Scratch& scratch)
+{
+    if (!scratch.isDirty[r])
+    {
+        scratch.isDirty[r] = true;
+        scratch.dirty.push_back(r);
+    }
+}
+
+// Rounds of taking the queued moves best first until none is left, each
+// starting with the pairs of the routes the last one changed
+inline bool Ants::drainMoves(Paths& paths, Scratch& scratch)
+{
+    bool improved = false;
+    Ints& dirty = scratch.dirty;
+    Ints& round = scratch.round;
+    while (!dirty.empty())
+    {
+        round.swap(dirty);
+        dirty.clear();
+        scratch.epoch++;
+        for (const int r : round)
+        {
+            scratch.isDirty[r] = false;
+            evalRoute(paths, r, scratch);
+        }
+
+        while (!scratch.moves.empty())
+        {
+            std::pop_heap(scratch.moves.begin(), scratch.moves.end());
+            Move m = scratch.moves.back();
+            scratch.moves.pop_back();
+            if (scratch.evalEpoch[m.via] > m.epoch)
+                continue;
+
+            const float queuedGain = m.gain;
+            priceMove(paths, m, scratch);
+            if (m.gain <= 0.0f)
+                continue;
+            if (m.gain < queuedGain || m.full >= 0)
+            {
+                queueMove(m, scratch);
+                continue;
+            }
+
+            const int r1 = scratch.routeOf[m.u], r2 = scratch.routeOf[m.v];
+            applyMove(paths, m, scratch);
+            improved = true;
+
+            for (const int r : {r1, r2})
+            {
+                markDirty(r, scratch);
 
-                    Path& path2 = paths[k];
-                    Ints& path2Hops = path2.hops;
-                    for (int node2Idx = 1; node2Idx < path2Hops.size() - 1; node2Idx++)
+                std::vector<Move>& parked = scratch.parked[r];
+                const int load = paths[r].load;
+                int kept = 0;
+                for (const Move& p : parked)
+                {
+                    if (load <= p.fitLoad)
                     {
-                        // node assignments must be in inner most loop
-                        // because after one change, the same node1 is no longer
-                        // in path1!!!
-                        const int node1Idx = j;
-                        const int node1 = path1Hops[node1Idx];
-                        const int node2 = path2Hops[node2Idx];
-
-                        float load1, load2;
-                        if (((load1 =
-                                    path1.load - this->myNodes[node1].z +
-                                    this->myNodes[path2.hops[node2Idx]].z)
-                                <= this->myVCap)
-                                &&
-                                ((load2 =
-                                      path2.load + this->myNodes[node1].z -
-                                      this->myNodes[path2.hops[node2Idx]].z)
-                                 <= this->myVCap))
-                        {
-                            const float oldPath1Cost = path1.cost;
-                            const float oldPath2Cost = path2.cost;
-                            const float oldCostSum = oldPath1Cost + oldPath2Cost;
-
-                            const float path1CostDiff = - this->myDists[path1Hops[node1Idx - 1]][node1]
-                                                        - this->myDists[node1][path1Hops[node1Idx + 1]]
-                                                        + this->myDists[path1Hops[node1Idx - 1]][node2]
-                                                        + this->myDists[node2][path1Hops[node1Idx + 1]];
-                            const float newPath1Cost = oldPath1Cost + path1CostDiff;
-                            const float path2CostDiff = - this->myDists[path2Hops[node2Idx - 1]][node2]
-                                                        - this->myDists[node2][path2Hops[node2Idx + 1]]
-                                                        + this->myDists[path2Hops[node2Idx - 1]][node1]
-                                                        + this->myDists[node1][path2Hops[node2Idx + 1]];
-                            const float newPath2Cost = oldPath2Cost + path2CostDiff;
-                            const float newCostSum = newPath1Cost + newPath2Cost;
-
-
-                            if (newCostSum < oldCostSum)
-                            {
-                                Ints oldPath1Hops = path1Hops;
-                                path1Hops[node1Idx] = node2;
-                                path1.load = load1;
-                                path1.cost = newPath1Cost;
-                                path2Hops[node2Idx] = node1;
-                                path2.load = load2;
-                                path2.cost = newPath2Cost;
-                                improved = true;
-                            }
-                        }
+                        scratch.moves.push_back(p);
+                        std::push_heap(scratch.moves.begin(), scratch.moves.end());
                     }
+                    else
+                        parked[kept++] = p;
                 }
+                parked.resize(kept);
             }
         }
     }
+
+    return improved;
 }
 
-inline void Ants::applyTwoOpt(Path& path)
+// The inter-route search on routes r1 and r2 alone. Customers of other
+// routes are left without a route, so it never looks past the pair, and
+// the two routes are left that way too when it is done. Moves stay
+// current by epoch without resetting evalEpoch, which no pair has to pay
+// for on every customer.
+inline bool Ants::improveRoutePair(Paths& paths, const int r1, const int r2, Scratch& scratch)
 {
-    // Get tour size
-    const int nHops = path.hops.size();
+    if (scratch.routeOf.size() < this->myDim)
+    {
+        scratch.routeOf.assign(this->myDim, -1);
+        scratch.pos.resize(this->myDim);
+        scratch.reach.resize(this->myDim);
+    }
+    if (scratch.evalEpoch.size() < this->myDim)
+        scratch.evalEpoch.assign(this->myDim, 0);
+    if (scratch.prefLoad.size() < paths.size())
+    {
+        scratch.prefLoad.resize(paths.size());
+        scratch.boxes.resize(paths.size());
+    }
+    if (scratch.parked.size() < paths.size())
+    {
+        scratch.parked.resize(paths.size());
+        scratch.isDirty.resize(paths.size(), false);
+    }
+
+    indexRoute(paths[r1], r1, scratch);
+    indexRoute(paths[r2], r2, scratch);
+    scratch.moves.clear();
+    scratch.parked[r1].clear();
+    scratch.parked[r2].clear();
+    markDirty(r1, scratch);
+    markDirty(r2, scratch);
+    const bool improved = drainMoves(paths, scratch);
+
+    for (const int r : {r1, r2})
+        for (const int c : paths[r].hops)
+            scratch.routeOf[c] = -1;
+    return improved;
+}
 
-    // repeat until no improvement is made
-    bool improved = true;
-    while (improved)
+// Route pairs with a customer within reach of a customer in the other,
+// as (first, second, their versions when last searched), with the versions
+// of pairs already known carried over. Returns whether any of them is due
+// to be searched.
+inline bool Ants::findRoutePairs(Paths& paths, Scratch& scratch)
+{
+    const int nRoutes = paths.size();
+    const int K = this->myDists.getNbrCount();
+    indexRoutes(paths, scratch);
+
+    Ints& keys = scratch.batch;
+    keys.clear();
+    for (int r = 0; r < nRoutes; r++)
     {
-        improved = false;
-        float bestCost = path.cost;
+        const Ints& hops = paths[r].hops;
+        for (int j = 1; j < (int) hops.size() - 1; j++)
+        {
+            const int c = hops[j];
+            const int *nbrs = this->myDists.getNbrs(c);
+            const float *nbrDists = this->myDists.getNbrDists(c);
+            for (int n = 0; n < K && nbrDists[n] < scratch.reach[c]; n++)
+            {
+                const int rv = scratch.routeOf[nbrs[n]];
+                if (rv != r)
+                    keys.push_back(std::min(r, rv) * nRoutes + std::max(r, rv));
+            }
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
 
-        #pragma omp simd
-        for (int i = 1; i < nHops - 2; i++)
+    // The routes' customers go back to having no route, as pair searches
+    // on this thread expect
+    for (const Path& p : paths)
+        for (int j = 1; j < (int) p.hops.size() - 1; j++)
+            scratch.routeOf[p.hops[j]] = -1;
+
+    // Both lists are in order, so the old versions are found in one pass
+    const Ints& old = scratch.routePairs;
+    const Ints& version = scratch.routeVersion;
+    Ints& pairs = scratch.pairsNext;
+    pairs.clear();
+    bool due = false;
+    int q = 0;
+    for (const int key : keys)
+    {
+        const int a = key / nRoutes, b = key % nRoutes;
+        while (q < old.size() && old[q] * nRoutes + old[q + 1] < key)
+            q += 4;
+
+        const bool known = q < old.size() && old[q] == a && old[q + 1] == b;
+        pairs.insert(pairs.end(), {a, b, known ? old[q + 2] : -1, known ? old[q + 3] : -1});
+        due = due || !known || old[q + 2] != version[a] || old[q + 3] != version[b];
+    }
+    scratch.routePairs.swap(pairs);
+    return due;
+}
+
+// Inter-route search as tasks over disjoint route pairs. Each batch is a
+// greedy matching of the pairs whose routes changed since they were last
+// searched, run in parallel, until no pair is left to search. Moves can
+// bring routes near each other that were not before, so the pairs are
+// found again after every pass that changed anything.
+inline bool Ants::improveRoutesInTasks(Paths& paths, Scratch& scratch)
+{
+    const int nRoutes = paths.size();
+    scratch.routePairs.clear();
+    scratch.routeVersion.assign(nRoutes, 0);
+    Ints &pairs = scratch.routePairs, &version = scratch.routeVersion;
+    Ints& batch = scratch.batch;
+
+    bool improved = false, changed = true;
+    while (changed && findRoutePairs(paths, scratch))
+    {
+        changed = false;
+        const int nPairs = pairs.size() / 4;
+        while (true)
         {
-            for (int j = i + 1; j < nHops - 1; j++)
+            scratch.busy.assign(nRoutes, false);
+            batch.clear();
+            for (int q = 0; q < nPairs; q++)
             {
+                const int a = pairs[4 * q], b = pairs[4 * q + 1];
+                if (scratch.busy[a] || scratch.busy[b] ||
+                        (pairs[4 * q + 2] == version[a] && pairs[4 * q + 3] == version[b]))
+                    continue;
 
-                const float costDiff =  - this->myDists[path.hops[i - 1]][path.hops[i]]
-                                        - this->myDists[path.hops[j]][path.hops[j + 1]]
-                                        + this->myDists[path.hops[i - 1]][path.hops[j]]
-                                        + this->myDists[path.hops[i]][path.hops[j + 1]];
+                scratch.busy[a] = scratch.busy[b] = true;
+                batch.push_back(q);
+            }
+            if (batch.empty())
+                break;
 
-                const float newCost = path.cost + costDiff;
+            const int nBatch = batch.size();
+            #pragma omp taskloop shared(paths, pairs, version, batch) grainsize(1) \
+                    reduction(||: changed)
+            for (int k = 0; k < nBatch; k++)
+            {
+                const int q = batch[k];
+                const int a = pairs[4 * q], b = pairs[4 * q + 1];
+                if (improveRoutePair(paths, a, b, this->myScratch[omp_get_thread_num()]))
+                {
+                    version[a]++;
+                    version[b]++;
+                    changed = true;
+                }
+                pairs[4 * q + 2] = version[a];
+                pairs[4 * q + 3] = version[b];
+            }
+        }
+        improved = improved || changed;
+    }
 
-                if (newCost < bestCost)
+    return improved;
+}
+
+// Each customer's route, position and reach, and route r's loads up to
+// every position. The route's load and cost are summed afresh on the way.
+inline void Ants::indexRoute(Path& path, const int r, Scratch& scratch)
+{
+    const Ints& hops = path.hops;
+    Floats& load = scratch.prefLoad[r];
+    load.resize(hops.size());
+
+    load[0] = 0.0f;
+    float cost = 0.0f;
+    for (int k = 1; k < hops.size(); k++)
+    {
+        load[k] = load[k - 1] + this->myNodes[hops[k]].z;
+        cost += this->myDists[hops[k - 1]][hops[k]];
+    }
+    path.load = load.back();
+    path.cost = cost;
+
+    // An emptied route keeps the depot's point, having no moves to bound
+    const Node& start = this->myNodes[hops[hops.size() > 2 ? 1 : 0]];
+    RouteBox& box = scratch.boxes[r];
+    box = {start.x, start.y, start.x, start.y, 0.0f};
+    for (int k = 1; k < (int) hops.size() - 1; k++)
+    {
+        const Node& n = this->myNodes[hops[k]];
+        box.minX = std::min(box.minX, n.x);
+        box.minY = std::min(box.minY, n.y);
+        box.maxX = std::max(box.maxX, n.x);
+        box.maxY = std::max(box.maxY, n.y);
+
+        const float dIn = this->myDists[hops[k - 1]][hops[k]];
+        const float dOut = this->myDists[hops[k]][hops[k + 1]];
+        scratch.routeOf[hops[k]] = r;
+        scratch.pos[hops[k]] = k;
+        scratch.reach[hops[k]] = std::max(std::max(dIn, dOut),
+                                          dIn + dOut - this->myDists[hops[k - 1]][hops[k + 1]]);
+    }
+    const Node& depot = this->myNodes[0];
+    box.depotGap = boxGap(box, {depot.x, depot.y, depot.x, depot.y, 0.0f});
+}
+
+inline void Ants::indexRoutes(Paths& paths, Scratch& scratch)
+{
+    if (scratch.routeOf.size() < this->myDim)
+    {
+        scratch.routeOf.resize(this->myDim);
+        scratch.pos.resize(this->myDim);
+        scratch.reach.resize(this->myDim);
+    }
+    // Never shrunk, so the per route buffers keep their capacity
+    if (scratch.prefLoad.size() < paths.size())
+    {
+        scratch.prefLoad.resize(paths.size());
+        scratch.boxes.resize(paths.size());
+    }
+
+    for (int r = 0; r < paths.size(); r++)
+        indexRoute(paths[r], r, scratch);
+}
+
+// Routes emptied by inter-route moves go, their hops back to the pool
+inline void Ants::dropEmptyPaths(Paths& paths, Scratch& scratch)
+{
+    int kept = 0;
+    for (int r = 0; r < paths.size(); r++)
+    {
+        if (paths[r].hops.size() > 2)
+        {
+            if (kept != r)
+                std::swap(paths[kept], paths[r]);
+            kept++;
+        }
+    }
+
+    while (paths.size() > kept)
+    {
+        scratch.spareHops.push_back(std::move(paths.back().hops));
+        paths.pop_back();
+    }
+}
+
+// 2-opt on the route as a cycle through the depot. Each node only tries
+// its nearest neighbours in the same route that are closer than its tour
+// neighbour, a node whose neighbourhood held no gain is not looked at
+// again until one of its edges changes, and a move reverses whichever
+// side of the cycle is shorter.
+inline void Ants::applyTwoOpt(Path& path, Scratch& scratch)
+{
+    const int m = path.hops.size() - 1;
+    if (m < 4)
+        return;
+
+    if (scratch.routeStamp.size() < this->myDim)
+    {
+        scratch.pos.resize(this->myDim);
+        scratch.routeStamp.resize(this->myDim, 0);
+        scratch.queued.resize(this->myDim, false);
+    }
+
+    Ints &tour = scratch.tour, &pos = scratch.pos, &queue = scratch.queue;
+    const int stamp = ++scratch.stamp;
+    tour.assign(path.hops.begin(), path.hops.end() - 1);
+    queue.clear();
+    for (int k = 0; k < m; k++)
+    {
+        pos[tour[k]] = k;
+        scratch.routeStamp[tour[k]] = stamp;
+        scratch.queued[tour[k]] = true;
+        queue.push_back(tour[k]);
+    }
+
+    auto next = [&](const int n, const bool forward)
+    {
+        const int k = pos[n];
+        return forward ? tour[k + 1 == m ? 0 : k + 1] : tour[k == 0 ? m - 1 : k - 1];
+    };
+
+    // Reverse the cycle from a forwards to b, or the rest of it if shorter
+    auto reverse = [&](const int a, const int b)
+    {
+        int i = pos[a], j = pos[b];
+        int len = (j - i + m) % m + 1;
+        if (2 * len > m)
+        {
+            i = j + 1 == m ? 0 : j + 1;
+            j = pos[a] == 0 ? m - 1 : pos[a] - 1;
+            len = m - len;
+        }
+        for (int s = 0; s < len / 2; s++)
+        {
+            std::swap(tour[i], tour[j]);
+            pos[tour[i]] = i;
+            pos[tour[j]] = j;
+            i = i + 1 == m ? 0 : i + 1;
+            j = j == 0 ? m - 1 : j - 1;
+        }
+    };
+
+    auto wake = [&](const int n)
+    {
+        if (!scratch.queued[n])
+        {
+            scratch.queued[n] = true;
+            queue.push_back(n);
+        }
+    };
+
+    const int K = this->myDists.getNbrCount();
+    for (int head = 0; head < queue.size(); head++)
+    {
+        const int t1 = queue[head];
+        scratch.queued[t1] = false;
+        const int *nbrs = this->myDists.getNbrs(t1);
+        const float *nbrDists = this->myDists.getNbrDists(t1);
+
+        // Replace (t1, t2) and (t3, t4) by (t1, t3) and (t2, t4), with t2
+        // and t4 both after or both before t1 and t3
+        for (const bool forward : {true, false})
+        {
+            const int t2 = next(t1, forward);
+            const float d12 = this->myDists[t1][t2];
+            bool moved = false;
+
+            for (int k = 0; k < K && nbrDists[k] < d12; k++)
+            {
+                const int t3 = nbrs[k];
+                if (scratch.routeStamp[t3] != stamp || t3 == t2)
+                    continue;
+
+                const int t4 = next(t3, forward);
+                if (t4 == t1)
+                    continue;
+
+                const float gain = d12 + this->myDists[t3][t4]
+                                   - this->myDists[t1][t3] - this->myDists[t2][t4];
+                if (isGain(gain, d12 + this->myDists[t3][t4]))
                 {
-                    std::reverse(path.hops.begin() + i, path.hops.begin() + j + 1);
-                    improved = true;
-                    path.cost = newCost;
-                    bestCost = newCost;
+                    forward ? reverse(t2, t3) : reverse(t1, t4);
+                    path.cost -= gain;
+                    for (const int n : {t1, t2, t3, t4})
+                        wake(n);
+                    moved = true;
+                    break;
                 }
             }
+
+            if (moved)
+                break;
         }
     }
+
+    // Back to a depot to depot route
+    const int start = pos[0];
+    for (int k = 0; k < m; k++)
+        path.hops[k] = tour[start + k < m ? start + k : start + k - m];
+    path.hops[m] = 0;
 }
 
-inline void Ants::applyShuffle(Path& path)
+// Or-opt: move a segment of 1 to ACO_OR_OPT_LEN nodes, either way round,
+// next to a nearest neighbour of one of its ends in the same route. Both
+// halves of the delta are O(1) and an applied move is a single rotation.
+// Nodes are queued as segment starts, with don't-look bits as in 2-opt.
+inline void Ants::applyOrOpt(Path& path, Scratch& scratch)
 {
-    // Get tour size
-    const int nHops = path.hops.size();
+    Ints& hops = path.hops;
+    const int n = hops.size();
+    if (n < 4)
+        return;
 
-    // repeat until no improvement is made
-    bool improved = true;
-    while (improved)
+    if (scratch.routeStamp.size() < this->myDim)
     {
-        improved = false;
-        float bestCost = path.cost;
+        scratch.pos.resize(this->myDim);
+        scratch.routeStamp.resize(this->myDim, 0);
+        scratch.queued.resize(this->myDim, false);
+    }
 
-        #pragma omp simd
-        for (int i = 1; i < nHops - 1; i++)
+    Ints &pos = scratch.pos, &queue = scratch.queue;
+    const int stamp = ++scratch.stamp;
+    queue.clear();
+    for (int k = 1; k < n - 1; k++)
+    {
+        pos[hops[k]] = k;
+        scratch.routeStamp[hops[k]] = stamp;
+        scratch.queued[hops[k]] = true;
+        queue.push_back(hops[k]);
+    }
+
+    auto wake = [&](const int node)
+    {
+        if (node != 0 && !scratch.queued[node])
+        {
+            scratch.queued[node] = true;
+            queue.push_back(node);
+        }
+    };
+
+    // Take hops[i, i + L) out and put it between hops[j] and hops[j + 1]
+    auto move = [&](const int i, const int L, const int j, const bool reversed)
+    {
+        int lo, hi, segStart;
+        if (j < i)
         {
-            for (int j = 1; j < nHops - 1; j++)
+            std::rotate(hops.begin() + j + 1, hops.begin() + i, hops.begin() + i + L);
+            lo = segStart = j + 1;
+            hi = i + L;
+        }
+        else
+        {
+            std::rotate(hops.begin() + i, hops.begin() + i + L, hops.begin() + j + 1);
+            lo = i;
+            segStart = j + 1 - L;
+            hi = j + 1;
+        }
+
+        if (reversed)
+            std::reverse(hops.begin() + segStart, hops.begin() + segStart + L);
+        for (int k = lo; k < hi; k++)
+            pos[hops[k]] = k;
+    };
+
+    // First improving insertion of the segment hops[i, i + L)
+    const int K = this->myDists.getNbrCount();
+    auto trySegment = [&](const int i, const int L)
+    {
+        const int p = hops[i - 1], s1 = hops[i], sL = hops[i + L - 1], nx = hops[i + L];
+        const float removeGain = this->myDists[p][s1] + this->myDists[sL][nx]
+                                 - this->myDists[p][nx];
+        if (removeGain <= 0.0f)
+            return false;
+
+        for (const bool fromFirst : {true, false})
+        {
+            const int end = fromFirst ? s1 : sL;
+            const int *nbrs = this->myDists.getNbrs(end);
+            const float *nbrDists = this->myDists.getNbrDists(end);
+
+            for (int k = 0; k < K && nbrDists[k] < removeGain; k++)
             {
-                if (abs(i - j) <= 1)
+                const int c = nbrs[k];
+                if (scratch.routeStamp[c] != stamp || (pos[c] >= i && pos[c] < i + L))
                     continue;
-                const int node = path.hops[i];
-                const int breakIdx = i < j ? j : j - 1;
-                const float costDiff = - this->myDists[path.hops[i - 1]][node]
-                                       - this->myDists[node][path.hops[i + 1]]
-                                       + this->myDists[path.hops[i - 1]][path.hops[i + 1]]
-                                       - this->myDists[path.hops[breakIdx]][path.hops[breakIdx + 1]]
-                                       + this->myDists[path.hops[breakIdx]][node]
-                                       + this->myDists[node][path.hops[breakIdx + 1]];
-
-                const float newCost = path.cost + costDiff;
-
-                if (newCost < bestCost)
+
+                // Between c and its successor, or its predecessor and c,
+                // turned so that the end near c lies next to it
+                for (const bool after : {true, false})
                 {
-                    path.hops.erase(path.hops.begin() + i, path.hops.begin() + i + 1);
-                    path.hops.insert(path.hops.begin() + j, node);
+                    const int j = after ? pos[c] : pos[c] - 1;
+                    if (j >= i - 1 && j < i + L)
+                        continue;
 
-                    improved = true;
-                    path.cost = newCost;
-                    bestCost = newCost;
+                    const int a = hops[j], b = hops[j + 1];
+                    const bool reversed = fromFirst != after;
+                    const float addCost = (reversed ?
+                                           this->myDists[a][sL] + this->myDists[s1][b] :
+                                           this->myDists[a][s1] + this->myDists[sL][b])
+                                          - this->myDists[a][b];
+
+                    const float gain = removeGain - addCost;
+                    const float removed = this->myDists[p][s1] + this->myDists[sL][nx] +
+                                          this->myDists[a][b];
+                    if (isGain(gain, removed))
+                    {
+                        move(i, L, j, reversed);
+                        path.cost -= gain;
+                        for (const int node : {p, nx, a, b, s1, sL})
+                            wake(node);
+                        return true;
+                    }
                 }
             }
         }
+
+        return false;
+    };
+
+    for (int head = 0; head < queue.size(); head++)
+    {
+        const int t = queue[head];
+        scratch.queued[t] = false;
+
+        for (int L = 1; L <= ACO_OR_OPT_LEN && pos[t] + L < n; L++)
+            if (trySegment(pos[t], L))
+                break;
     }
 }
 
-inline void Ants::improvePaths(Paths& paths)
+// Or-3opt: sequential 3-opt in the manner of Lin-Kernighan, on the route
+// as a cycle through the depot. From t1 and a tour neighbour t2, t3 is a
+// nearest neighbour of t2 and t4 a tour neighbour of t3; the chain either
+// closes back to t1 or goes one step further, through a nearest neighbour
+// t5 of t4 and a tour neighbour t6 of t5. The partial gain must stay
+// positive at every step, which bounds both neighbour scans, and the first
+// closing that leaves a single cycle is taken. Or-opt moves of any length
+// are among these, so this replaces both 2-opt and Or-opt.
+inline void Ants::applyOrThreeOpt(Path& path, Scratch& scratch)
 {
+    const int m = path.hops.size() - 1;
+    if (m < 4)
+        return;
+
+    if (scratch.routeStamp.size() < this->myDim)
+    {
+        scratch.pos.resize(this->myDim);
+        scratch.routeStamp.resize(this->myDim, 0);
+        scratch.queued.resize(this->myDim, false);
+    }
+
+    Ints &tour = scratch.tour, &pos = scratch.pos, &queue = scratch.queue;
+    const int stamp = ++scratch.stamp;
+    tour.assign(path.hops.begin(), path.hops.end() - 1);
+    queue.clear();
+    for (int k = 0; k < m; k++)
+    {
+        pos[tour[k]] = k;
+        scratch.routeStamp[tour[k]] = stamp;
+        scratch.queued[tour[k]] = true;
+        queue.push_back(tour[k]);
+    }
+
+    auto next = [&](const int n, const bool forward)
+    {
+        const int k = pos[n];
+        return forward ? tour[k + 1 == m ? 0 : k + 1] : tour[k == 0 ? m - 1 : k - 1];
+    };
+
+    auto wake = [&](const int n)
+    {
+        if (!scratch.queued[n])
+        {
+            scratch.queued[n] = true;
+            queue.push_back(n);
+        }
+    };
+
+    // Remove edges (t[2i], t[2i + 1]) and add (t[2i + 1], t[2i + 2]), the
+    // last one back to t[0], if that leaves a single cycle. The cuts split
+    // the tour into segments, each with a head and a tail port; the added
+    // edges join ports, and the new tour follows them from segment 0.
+    int t[6], cuts[3], link[6];
+    auto reconnect = [&](const int nCuts)
+    {
+        for (int i = 0; i < nCuts; i++)
+            cuts[i] = next(t[2 * i], true) == t[2 * i + 1] ? pos[t[2 * i]] : pos[t[2 * i + 1]];
+        std::sort(cuts, cuts + nCuts);
+        for (int i = 1; i < nCuts; i++)
+            if (cuts[i] == cuts[i - 1])
+                return false;
+
+        // Segment s runs from after cuts[s] to cuts[s + 1]: port 2s is its
+        // head and 2s + 1 its tail
+        auto portOf = [&](const int node, const int other)
+        {
+            const int k = pos[node];
+            const bool tail = next(node, true) == other;
+            const int s = std::find(cuts, cuts + nCuts, tail ? k : (k == 0 ? m - 1 : k - 1)) - cuts;
+            return tail ? 2 * ((s + nCuts - 1) % nCuts) + 1 : 2 * s;
+        };
+        for (int i = 0; i < nCuts; i++)
+        {
+            const int a = t[2 * i + 1], b = t[(2 * i + 2) % (2 * nCuts)];
+            const int pa = portOf(a, t[2 * i]), pb = portOf(b, t[(2 * i + 3) % (2 * nCuts)]);
+            link[pa] = pb;
+            link[pb] = pa;
+        }
+
+        int port = 0, nSegs = 0;
+        do
+        {
+            nSegs++;
+            port = link[port ^ 1];
+        }
+        while (port != 0 && nSegs < nCuts);
+        if (port != 0 || nSegs != nCuts)
+            return false;
+
+        Ints& rebuilt = scratch.segA;
+        rebuilt.clear();
+        do
+        {
+            const int s = port / 2;
+            const int head = cuts[s] + 1 == m ? 0 : cuts[s] + 1, tail = cuts[(s + 1) % nCuts];
+            const int len = (tail - head + m) % m + 1;
+            for (int k = 0, at = port & 1 ? tail : head; k < len; k++)
+            {
+                rebuilt.push_back(tour[at]);
+                at = port & 1 ? (at == 0 ? m - 1 : at - 1) : (at + 1 == m ? 0 : at + 1);
+            }
+            port = link[port ^ 1];
+        }
+        while (port != 0);
+
+        tour.swap(rebuilt);
+        for (int k = 0; k < m; k++)
+            pos[tour[k]] = k;
+        return true;
+    };
+
+    const int K = this->myDists.getNbrCount();
+    auto improveFrom = [&](const int t1)
+    {
+        for (const bool forward : {true, false})
+        {
+            const int t2 = next(t1, forward);
+            const float d12 = this->myDists[t1][t2];
+            const int *nbrs2 = this->myDists.getNbrs(t2);
+            const float *nbrDists2 = this->myDists.getNbrDists(t2);
+
+            for (int k = 0; k < K && nbrDists2[k] < d12; k++)
+            {
+                const int t3 = nbrs2[k];
+                if (scratch.routeStamp[t3] != stamp || t3 == t1 || t3 == next(t2, forward))
+                    continue;
+
+                const float g1 = d12 - nbrDists2[k];
+                for (const bool after : {true, false})
+                {
+                    const int t4 = next(t3, after);
+                    const float d34 = this->myDists[t3][t4];
+                    const float g2 = g1 + d34;
+                    t[0] = t1; t[1] = t2; t[2] = t3; t[3] = t4;
+
+                    const float gain2 = g2 - this->myDists[t4][t1];
+                    if (isGain(gain2, d12 + d34) && reconnect(2))
+                    {
+                        path.cost -= gain2;
+                        for (int i = 0; i < 4; i++)
+                            wake(t[i]);
+                        return true;
+                    }
+
+                    const int *nbrs4 = this->myDists.getNbrs(t4);
+                    const float *nbrDists4 = this->myDists.getNbrDists(t4);
+                    for (int k4 = 0; k4 < K && nbrDists4[k4] < g2; k4++)
+                    {
+                        const int t5 = nbrs4[k4];
+                        if (scratch.routeStamp[t5] != stamp ||
+                                t5 == next(t4, true) || t5 == next(t4, false))
+                            continue;
+
+                        const float g3 = g2 - nbrDists4[k4];
+                        for (const bool after6 : {true, false})
+                        {
+                            const int t6 = next(t5, after6);
+                            const float d56 = this->myDists[t5][t6];
+                            const float gain3 = g3 + d56 - this->myDists[t6][t1];
+                            t[0] = t1; t[1] = t2; t[2] = t3; t[3] = t4; t[4] = t5; t[5] = t6;
+                            if (isGain(gain3, d12 + d34 + d56) && reconnect(3))
+                            {
+                                path.cost -= gain3;
+                                for (int i = 0; i < 6; i++)
+                                    wake(t[i]);
+                                return true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        return false;
+    };
+
+    for (int head = 0; head < queue.size(); head++)
+    {
+        const int t1 = queue[head];
+        scratch.queued[t1] = false;
+        improveFrom(t1);
+    }
+
+    // Back to a depot to depot route
+    const int start = pos[0];
+    for (int k = 0; k < m; k++)
+        path.hops[k] = tour[start + k < m ? start + k : start + k - m];
+    path.hops[m] = 0;
+}
+
+// Exact ordering of a short route by Held-Karp: best[S][k] is the
+// shortest path from the depot through the customers in S that ends at k.
+// Each entry is a minimum over the customer before k of a row of the
+// table plus a row of distances into k; customers outside S stand at
+// infinity in the row, so the loop needs no test and vectorises. The
+// route is then read back from the table by finding which entry each
+// minimum came from.
+inline void Ants::applyHeldKarp(Path& path, Scratch& scratch)
+{
+    Ints& hops = path.hops;
+    const int n = hops.size() - 2;
+    if (n < 3)
+        return;
+
+    const int full = (1 << n) - 1;
+    const float inf = std::numeric_limits<float>::infinity();
+    Ints& nodes = scratch.tour;
+    nodes.assign(hops.begin() + 1, hops.end() - 1);
+
+    Floats &dists = scratch.hkDists, &best = scratch.hkTable;
+    dists.resize(n * n + n);
+    const float *fromDepot = &dists[n * n];
+    for (int k = 0; k < n; k++)
+    {
+        for (int j = 0; j < n; j++)
+            dists[k * n + j] = this->myDists[nodes[j]][nodes[k]];
+        dists[n * n + k] = this->myDists[0][nodes[k]];
+    }
+
+    best.assign((size_t) (full + 1) * n, inf);
+    for (int k = 0; k < n; k++)
+        best[(size_t) (1 << k) * n + k] = fromDepot[k];
+
+    for (int mask = 1; mask <= full; mask++)
+    {
+        if ((mask & (mask - 1)) == 0)
+            continue;
+
+        for (int k = 0; k < n; k++)
+        {
+            if (!(mask & (1 << k)))
+                continue;
+
+            const float *prev = &best[(size_t) (mask ^ (1 << k)) * n];
+            const float *into = &dists[k * n];
+            float m = inf;
+            #pragma omp simd reduction(min: m)
+            for (int j = 0; j < n; j++)
+                m = std::min(m, prev[j] + into[j]);
+            best[(size_t) mask * n + k] = m;
+        }
+    }
+
+    int last = 0;
+    float bestCost = inf;
+    for (int k = 0; k < n; k++)
+    {
+        const float cost = best[(size_t) full * n + k] + fromDepot[k];
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            last = k;
+        }
+    }
+
+    for (int mask = full, k = last, at = n; at > 0; at--)
+    {
+        hops[at] = nodes[k];
+        const int prevMask = mask ^ (1 << k);
+        if (prevMask == 0)
+            break;
+
+        const float *prev = &best[(size_t) prevMask * n];
+        const float *into = &dists[k * n];
+        int from = -1;
+        for (int j = 0; j < n; j++)
+            if (prevMask & (1 << j) &&
+                    (from < 0 || prev[j] + into[j] < prev[from] + into[from]))
+                from = j;
+        mask = prevMask;
+        k = from;
+    }
+
+    path.cost = 0.0f;
+    for (int k = 1; k < hops.size(); k++)
+        path.cost += this->myDists[hops[k - 1]][hops[k]];
+}
+
+inline void Ants::improvePath(Path& path, Scratch& scratch)
+{
+    RouteMemo::Key key;
+    const bool memo = this->myRouteMemo.isEnabled() && this->myRouteMemo.fits(path.hops);
+    if (memo)
+    {
+        key = this->myRouteMemo.makeKey(path.hops);
+        if (this->myRouteMemo.find(key, path.hops, path.cost))
+            return;
+    }
+
+    if ((int) path.hops.size() - 2 <= this->myHeldKarp)
+        applyHeldKarp(path, scratch);
+    else switch (this->myIntraMode)
+    {
+    case INTRA_TWOOPT:
+        applyTwoOpt(path, scratch);
+        applyOrOpt(path, scratch);
+        break;
+    case INTRA_OR3OPT:
+        applyOrThreeOpt(path, scratch);
+        break;
+    default:
+        die("Unknown intra-route mode: %s\n", Intra_Mode_String[this->myIntraMode]);
+    }
+
+    if (memo)
+        this->myRouteMemo.store(key, path.hops, path.cost);
+}
+
+inline void Ants::improvePaths(Paths& paths, Scratch& scratch)
+{
+    if (this->myRouteTasks)
+    {
+        improvePathsInTasks(paths, scratch);
+        return;
+    }
+
     for (Path& p : paths)
+        improvePath(p, scratch);
+
+    // Then the inter-route moves, and the routes are tidied up again if
+    // any of them changed
+    if (improveRoutes(paths, scratch))
     {
-        applyTwoOpt(p);
-        applyShuffle(p);
+        dropEmptyPaths(paths, scratch);
+        for (Path& p : paths)
+            improvePath(p, scratch);
     }
+}
 
-    applyOneExchange(paths);
+// improvePaths with the routes as tasks. Each task works in the buffers
+// of the thread that runs it. Those are free because the tasks are tied
+// and improvePath and improveRoutePair hold no task scheduling point, so
+// a thread cannot start another task in the middle of one. Making the
+// tasks untied, or adding a taskyield or a nested task to either search,
+// would let two tasks on one thread share its buffers.
+inline void Ants::improvePathsInTasks(Paths& paths, Scratch& scratch)
+{
+    const int nRoutes = paths.size();
+    #pragma omp taskloop shared(paths) grainsize(ACO_TASK_GRAIN)
+    for (int r = 0; r < nRoutes; r++)
+        improvePath(paths[r], this->myScratch[omp_get_thread_num()]);
+
+    if (improveRoutesInTasks(paths, scratch))
+    {
+        dropEmptyPaths(paths, scratch);
+        const int nLeft = paths.size();
+        #pragma omp taskloop shared(paths) grainsize(ACO_TASK_GRAIN)
+        for (int r = 0; r < nLeft; r++)
+            improvePath(paths[r], this->myScratch[omp_get_thread_num()]);
+    }
 }
 
-inline Ints Ants::pathToHops(const Paths &paths)
+inline void Ants::pathToHops(const Paths &paths, Ints& hops)
 {
-    Ints hops;
+    hops.clear();
 
     #pragma omp simd
     for (int i = 0; i < paths.size(); i++)
@@ -215,8 +1418,6 @@ inline Ints Ants::pathToHops(const Paths &paths)
                     paths[i].hops.begin(),
                     i < paths.size() - 1 ?
                     paths[i].hops.end() - 1 : paths[i].hops.end());
-
-    return hops;
 }
 
 inline float Ants::sumPathCosts(const Paths &paths)
@@ -227,9 +1428,30 @@ inline float Ants::sumPathCosts(const Paths &paths)
     return cost;
 }
 
-inline Ants::Paths Ants::wayPointsToPaths(WayPoints localWayPoints)
+// Path costs are only approximate on quantised distances, so anything
+// compared against the best is rescored exactly
+inline float Ants::scorePaths(const Paths &paths)
+{
+    if (this->myDists.isExact())
+        return sumPathCosts(paths);
+
+    double cost = 0.0;
+    for (const Path& p : paths)
+        for (int i = 1; i < p.hops.size(); i++)
+            cost += Score::serious(this->myNodes[p.hops[i - 1]], this->myNodes[p.hops[i]]);
+    return cost;
+}
+
+inline void Ants::wayPointsToPaths(Scratch& scratch)
 {
-    Paths paths;
+    WayPoints& localWayPoints = scratch.wayPoints;
+    Paths& paths = scratch.paths;
+
+    // The previous ant's hops go back to the pool with their capacity
+    for (Path& p : paths)
+        scratch.spareHops.push_back(std::move(p.hops));
+    paths.clear();
+
     for (int i = 1; i < this->myDim; i++)
     {
         WayPoint *wp = &localWayPoints[i];
@@ -237,8 +1459,15 @@ inline Ants::Paths Ants::wayPointsToPaths(WayPoints localWayPoints)
         // Traverse only if not marked as visited and is a terminal node
         if (wp->left != -1 && wp->right * wp->left == 0)
         {
-            Path newPath;
+            paths.emplace_back();
+            Path& newPath = paths.back();
             newPath.cost = 0.0f;
+            if (!scratch.spareHops.empty())
+            {
+                newPath.hops = std::move(scratch.spareHops.back());
+                newPath.hops.clear();
+                scratch.spareHops.pop_back();
+            }
 
             // First node is depot
             newPath.hops.push_back(0);
@@ -266,17 +1495,14 @@ inline Ants::Paths Ants::wayPointsToPaths(WayPoints localWayPoints)
                 wp->left = -1;
             }
             while (true);
-
-            paths.push_back(newPath);
         }
     }
-
-    return paths;
 }
 
-inline Ants::WayPoints Ants::applySavings(unsigned int& seed, Trails lclTrails)
+inline void Ants::applySavings(unsigned int& seed, Scratch& scratch)
 {
-    WayPoints wayPoints = WayPoints(this->myDim);
+    WayPoints& wayPoints = scratch.wayPoints;
+    wayPoints.resize(this->myDim);
 
     #pragma omp simd
     for (int i = 1; i < this->myDim; i++)
@@ -285,66 +1511,87 @@ inline Ants::WayPoints Ants::applySavings(unsigned int& seed, Trails lclTrails)
         wayPoints[i].otherEnd = &wayPoints[i];
     }
 
-    // Apply savings until no more feasible
-    while (lclTrails.size() > 0)
+    // The sampling window is the first myNBHood feasible trails. Trails
+    // enter the weight tree in order, checked on entry, only as far as that
+    // window needs; infeasibility is permanent, so a trail past the frontier
+    // is never touched until the window reaches it. Every tree entry is
+    // therefore in the window and a draw is one descent of the tree.
+    //
+    // The tree and the live flags are cleared over all trails only when
+    // first sized. The walk ends with every flag down, and it undoes just
+    // the tree entries it made, so an ant pays for the trails that entered
+    // rather than for all of them.
+    const int nTrails = this->myTrails.size();
+    const Floats& attrs = this->myAttr[this->myAttrFront];
+    Fenwick<double>& weights = scratch.weights;
+    std::vector<char>& live = scratch.live;
+    Ints& entered = scratch.entered;
+    if (weights.size() != nTrails)
     {
-        // Accumulate probabilities (no need to sort)
-        const int cmlProbsSize = std::min(myNBHood, (int) lclTrails.size());
-        Floats cmlProbs = Floats(cmlProbsSize, 0.0f);
-        float probSum = 0.0f;
+        weights.reset(nTrails);
+        live.assign(nTrails, false);
+    }
+    entered.clear();
+    int frontier = 0, nLive = 0;
 
-        #pragma omp simd
-        for (int i = 0; i < cmlProbsSize; i++)
+    auto feasible = [&](const Trail & s)
+    {
+        const WayPoint &w1 = wayPoints[s.n1], &w2 = wayPoints[s.n2];
+        return (w1.left * w1.right == 0) && (w2.left * w2.right == 0) &&
+               (w1.load + w2.load <= this->myVCap) &&
+               (w1.otherEnd != &w2);
+    };
+
+    auto kill = [&](const int i)
+    {
+        if (live[i])
         {
-            const Trail& s = lclTrails[i];
-            cmlProbs[i] = (probSum += pow(s.gain, myAlpha) * pow(s.pheromone, myBeta));
+            live[i] = false;
+            weights.add(i, -attrs[i]);
+            nLive--;
         }
+    };
 
-        // Roll dice and find corresponding id
-        const float dice = jRNG::frand(seed) * probSum;
-        int chosenSId = -1;
-        for (int i = 0; i < cmlProbsSize; i++)
+    // Apply savings until no more feasible
+    while (true)
+    {
+        for (; frontier < nTrails && nLive < myNBHood; frontier++)
         {
-            if (dice <= cmlProbs[i])
+            if (feasible(this->myTrails[frontier]))
             {
-                chosenSId = i;
-                break;
+                live[frontier] = true;
+                weights.add(frontier, attrs[frontier]);
+                entered.push_back(frontier);
+                nLive++;
             }
         }
 
-        if (chosenSId == -1)
-            die("Could not find saving ID! cmlProbsSize=%d, dice=%.2f, probSum=%.2f\n",
-                cmlProbsSize, dice, probSum);
-
-        const Savings::Saving& chosenSaving = lclTrails[chosenSId];
-        // dbg("Saving %d~%d, id: %d, savings size: %d\n",
-        //     chosenSaving.n1, chosenSaving.n2, chosenSId, lclTrails.size());
+        // All flags are down; rounding may have left the tree otherwise
+        if (nLive == 0)
+        {
+            weights.zero(entered);
+            break;
+        }
 
-        WayPoint &w1 = wayPoints[chosenSaving.n1], &w2 = wayPoints[chosenSaving.n2];
+        // Roll dice and find corresponding id
+        const double dice = jRNG::frand(seed) * weights.prefix(frontier - 1);
+        int chosenSId = std::min(weights.lowerBound(dice), frontier - 1);
 
-        // debug only
-        // if (w1.left * w1.right != 0 || w2.left * w2.right != 0)
-        //     die("Illegal saving: %d(%d, %d), %d(%d, %d)\n",
-        //         chosenSaving.n1, w1.left, w1.right, chosenSaving.n2, w2.left, w2.right);
+        // Rounding can land on a removed trail - take the nearest live one
+        while (chosenSId > 0 && !live[chosenSId])
+            chosenSId--;
+        while (!live[chosenSId])
+            chosenSId++;
 
-        // if (w1.left == chosenSaving.n2 || w1.right == chosenSaving.n2)
-        //     die("Illegal saving %d~%d, n1: %d(%d, %d)\n",
-        //         chosenSaving.n1, chosenSaving.n2, chosenSaving.n1, w1.left, w1.right);
+        const Savings::Saving& chosenSaving = this->myTrails[chosenSId];
+        kill(chosenSId);
 
-        // if (w2.left == chosenSaving.n1 || w2.right == chosenSaving.n1)
-        //     die("Illegal saving %d~%d, n2: %d(%d, %d)\n",
-        //         chosenSaving.n1, chosenSaving.n2, chosenSaving.n2, w2.left, w2.right);
+        WayPoint &w1 = wayPoints[chosenSaving.n1], &w2 = wayPoints[chosenSaving.n2];
+        const int end1 = w1.otherEnd - &wayPoints[0], end2 = w2.otherEnd - &wayPoints[0];
 
         w1.left == 0 ? w1.left = chosenSaving.n2 : w1.right = chosenSaving.n2;
         w2.left == 0 ? w2.left = chosenSaving.n1 : w2.right = chosenSaving.n1;
 
-        // dbg("Connection status: %d(%d, %d), %d(%d, %d)\n",
-        //     chosenSaving.n1, w1.left, w1.right, chosenSaving.n2, w2.left, w2.right);
-
-        // dbg("Old cluster loads(%d, %d) = (%d ::> %d), (%d ::> %d)\n",
-        //     chosenSaving.n1, chosenSaving.n2, w1.load, (*w1.otherEnd).load,
-        //     w2.load, (*w2.otherEnd).load);
-
         const int newLoad = (w1.load + w2.load);
         w1.load = (w2.load = ((*w1.otherEnd).load = ((*w2.otherEnd).load = newLoad)));
 
@@ -353,57 +1600,136 @@ inline Ants::WayPoints Ants::applySavings(unsigned int& seed, Trails lclTrails)
         (*w1.otherEnd).otherEnd = w2.otherEnd;
         (*w2.otherEnd).otherEnd = tmp;
 
-        // dbg("    New cluster loads(%d, %d) = (%d ::> %d), (%d ::> %d)\n",
-        //     chosenSaving.n1, chosenSaving.n2, w1.load, (*w1.otherEnd).load,
-        //     w2.load, (*w2.otherEnd).load);
-
         if (w1.load > this->myVCap)
             die("Cluster overload: %d\n", w1.load);
 
-        // Remove infeasible savings - node sealed if not reaching depot
-        const int toRemove1 = w1.left * w1.right > 0 ? chosenSaving.n1 : -1;
-        const int toRemove2 = w2.left * w2.right > 0 ? chosenSaving.n2 : -1;
-
-        // dbg("To remove1: %d\n", toRemove1);
-        // dbg("To remove2: %d\n", toRemove2);
-
-        const int myVCap = this->myVCap;
-        lclTrails.erase(
-            std::remove_if(
-                lclTrails.begin(),
-                lclTrails.end(),
-                [&myVCap, &wayPoints, &chosenSaving, &toRemove1, &toRemove2]
-                (const Savings::Saving & s)
+        // A node sealed off from the depot takes all of its trails with
+        // it, and the merged route's ends are the only other nodes whose
+        // load or partner changed. Trails are indexed in order, so only
+        // those before the frontier need a look.
+        for (const int n : {chosenSaving.n1, chosenSaving.n2, end1, end2})
         {
-            return (s.n1 == chosenSaving.n1 && s.n2 == chosenSaving.n2) ||
-                   (s.n1 == toRemove1 || s.n2 == toRemove1) ||
-                   (s.n1 == toRemove2 || s.n2 == toRemove2) ||
-                   (wayPoints[s.n1].load + wayPoints[s.n2].load > myVCap) ||
-                   (wayPoints[s.n1].otherEnd == &wayPoints[s.n2]);
-        }),
-        lclTrails.end());
+            for (int t = this->myNodeTrailStart[n];
+                    t < this->myNodeTrailStart[n + 1] && this->myNodeTrails[t] < frontier;
+                    t++)
+            {
+                const int id = this->myNodeTrails[t];
+                if (live[id] && !feasible(this->myTrails[id]))
+                    kill(id);
+            }
+        }
     }
+}
 
-    return wayPoints;
+inline Ants::Paths& Ants::walk(unsigned int& seed, Scratch& scratch)
+{
+    applySavings(seed, scratch);
+    wayPointsToPaths(scratch);
+
+    return scratch.paths;
 }
 
-inline Ants::Paths Ants::walk(unsigned int& seed)
+// Scores are positive, so their bits order like the floats themselves.
+// Packed above the thread id, one compare-and-swap publishes both.
+static inline uint64_t packBest(const float score, const int tid)
 {
-    WayPoints wayPoints = applySavings(seed, this->myTrails);
+    uint32_t bits;
+    memcpy(&bits, &score, sizeof(bits));
+    return ((uint64_t) bits << 32) | (uint32_t) tid;
+}
 
-    return wayPointsToPaths(wayPoints);
+static inline float unpackScore(const uint64_t packed)
+{
+    const uint32_t bits = packed >> 32;
+    float score;
+    memcpy(&score, &bits, sizeof(score));
+    return score;
+}
+
+static inline int unpackThread(const uint64_t packed)
+{
+    return (int) (uint32_t) packed;
+}
+
+void Ants::joinIslands(Islands& islands, const int island)
+{
+    this->myIslands = &islands;
+    this->myIsland = island;
+}
+
+void Ants::shareBest(SharedBest& shared)
+{
+    if (shared.isEnabled())
+        this->myShared = &shared;
+}
+
+void Ants::checkpointTo(const String& path, const int intervalSec, const bool resume)
+{
+    this->myCheckpointPath = path;
+    this->myCheckpointSec = intervalSec;
+    this->myResume = resume;
+}
+
+void Ants::streamTo(SolutionWriter& writer)
+{
+    this->myWriter = &writer;
 }
 
 void Ants::search(Route& bestRoute, const double startTime)
 {
-    float bestScore = bestRoute.calcScoreWithCache(this->myDists);
+    float bestScore = this->myDists.isExact() ?
+                      bestRoute.calcScoreWithCache(this->myDists) :
+                      bestRoute.calcScoreSerious();
     float prevBestScore = bestScore;
     long stagnantCount = 0;
     int itr = 0, nPheroAtMin = 0;
-    float stagnancy, currMinPhero;
+#if COUNT_ALLOCS
+    // Heap allocations by each thread over the last ants
+    std::vector<long> threadAllocs(omp_get_max_threads(), 0);
+#endif
+    float stagnancy, currMinPhero = 1.0f;
     double secElapsed = 0;
-    Edges bestEdges;
-    Cache<bool> taken;
+    bool resetPhero = false;
+    // Trails on the best route, by id, and what they get this iteration
+    Ints taken;
+    Floats deposits;
+    auto markBestEdges = [&]()
+    {
+        taken.clear();
+        for (const Int2& edge : bestRoute.getEdges())
+        {
+            const int id = edge.x > 0 && edge.y > 0 ? findTrail(edge.x, edge.y) : -1;
+            if (id >= 0)
+                taken.push_back(id);
+        }
+        std::sort(taken.begin(), taken.end());
+        deposits = Floats(taken.size());
+    };
+    markBestEdges();
+
+    // Elite filter: only ants built at or under eliteCut get the local
+    // search. The cut is the eliteShare quantile of the previous
+    // iteration's built costs, or the gap above the cheapest of them if
+    // that is higher. A few ants past the cut are searched anyway, and
+    // each of those audits that finds a new best widens the share.
+    const bool eliteOn = this->myEliteShare < 1.0f;
+    float eliteShare = this->myEliteShare;
+    float eliteCut = std::numeric_limits<float>::max();
+    long nSearched = 0, nSkipped = 0, nAudited = 0, nAuditHits = 0;
+    long totSearched = 0, totSkipped = 0, totAudited = 0, totAuditHits = 0;
+    Floats builtCosts;
+
+    // Route and score of the best route another island or process sent
+    Ints immigrant;
+    float immigrantScore;
+
+    // Pheromone figures of each thread's slice from the last update
+    Floats threadMinPhero(omp_get_max_threads(), DEFAULT_ACO_PHEROMONE);
+    Ints threadAtMin(omp_get_max_threads(), 0);
+
+    // Best score and the thread whose bestHops hold it; -1 is the route
+    // passed in
+    std::atomic<uint64_t> best(packBest(bestScore, -1));
 
     msg("ACO settings: \n");
     raw_at(LOG_MESSAGE, "alpha:         %.3f\n",    this->myAlpha);
@@ -414,70 +1740,207 @@ void Ants::search(Route& bestRoute, const double startTime)
     raw_at(LOG_MESSAGE, "popSize:       %ld\n",     this->myPopSize);
     raw_at(LOG_MESSAGE, "maxStag:       %ld\n",     this->myMaxStag);
     raw_at(LOG_MESSAGE, "timeLimSec:    %ld\n",     this->myTimeLimSec);
+    raw_at(LOG_MESSAGE, "intraMode:     %s\n",      Intra_Mode_String[this->myIntraMode]);
+    raw_at(LOG_MESSAGE, "heldKarp:      %d\n",      this->myHeldKarp);
+    raw_at(LOG_MESSAGE, "routeTasks:    %s\n",      this->myRouteTasks ? "yes" : "no");
+    raw_at(LOG_MESSAGE, "memoSlots:     %d\n",      this->myRouteMemo.getSlots());
+    raw_at(LOG_MESSAGE, "eliteShare:    %.3f\n",    this->myEliteShare);
+    raw_at(LOG_MESSAGE, "eliteGap:      %.3f\n",    this->myEliteGap);
     dbg("Initial route: %s", Route::genStr(bestRoute.getHops()).c_str());
 
+    this->myScratch = std::vector<Scratch>(omp_get_max_threads());
+
+    // Each thread's RNG seed as it stood after its last ant, for the
+    // checkpoints to carry
+    std::vector<unsigned int> threadSeeds(omp_get_max_threads());
+    for (int t = 0; t < threadSeeds.size(); t++)
+        threadSeeds[t] = this->mySpec.rand_seed + t + ACO_ISLAND_SEED_STEP * this->myIsland;
+
+    // Time is counted from timeOrigin, which a resumed search moves back
+    // by the time it had already spent
+    double timeOrigin = startTime;
+    const bool checkpointOn = !this->myCheckpointPath.empty();
+    double lastCheckpointSec = 0;
+    // Best score last handed to the writer
+    float streamedScore = std::numeric_limits<float>::max();
+
+    // Settings that shape the pheromones and the elite cut, which a
+    // resumed search has to share with the one it carries on from
+    static const char *settingNames[] = {"alpha", "beta", "pers", "minPhero", "nbhood",
+                                         "granularity", "eliteShare", "eliteGap"};
+    const Floats settings = {this->myAlpha, this->myBeta, this->myPers, this->myMinPhero,
+                             (float) this->myNBHood, (float) this->myGranularity,
+                             this->myEliteShare, this->myEliteGap};
+
+    // Taken at the very end of the bookkeeping, when the ants are done
+    // and the pheromone update has yet to start
+    auto saveCheckpoint = [&]()
+    {
+        Checkpoint ck;
+        ck.key = this->mySpec.fingerprint();
+        ck.nTrails = this->myTrails.size();
+        ck.nThreads = omp_get_num_threads();
+        ck.settings = settings;
+        ck.itr = itr;
+        ck.attrFront = this->myAttrFront;
+        ck.stagnantCount = stagnantCount;
+        ck.secElapsed = secElapsed;
+        ck.bestScore = bestScore;
+        ck.eliteShare = eliteShare;
+        ck.eliteCut = eliteCut;
+        ck.resetPhero = resetPhero;
+        ck.totSearched = totSearched;
+        ck.totSkipped = totSkipped;
+        ck.totAudited = totAudited;
+        ck.totAuditHits = totAuditHits;
+        ck.bestHops = bestRoute.getHops();
+        ck.phero = this->myPhero;
+        ck.frontAttr = this->myAttr[this->myAttrFront];
+        ck.deposits = deposits;
+        ck.seeds = threadSeeds;
+
+        if (ck.save(this->myCheckpointPath))
+            dbg("Checkpoint at iteration %d\n", itr);
+    };
+
+    if (checkpointOn && this->myResume)
+    {
+        Checkpoint ck;
+        if (!ck.load(this->myCheckpointPath))
+            die("Cannot resume from %s\n", this->myCheckpointPath.c_str());
+        if (ck.key != this->mySpec.fingerprint() || ck.nTrails != this->myTrails.size() ||
+                ck.phero.size() != ck.nTrails || ck.frontAttr.size() != ck.nTrails)
+            die("Checkpoint %s is for another instance or settings\n",
+                this->myCheckpointPath.c_str());
+        if (ck.settings.size() != settings.size())
+            die("Checkpoint %s is damaged\n", this->myCheckpointPath.c_str());
+        for (int k = 0; k < settings.size(); k++)
+            if (ck.settings[k] != settings[k])
+                die("Checkpoint %s was taken with %s %g, not %g\n",
+                    this->myCheckpointPath.c_str(), settingNames[k], ck.settings[k], settings[k]);
+        if (ck.nThreads != omp_get_max_threads())
+            wrn("Checkpoint was taken with %d threads, not %d, so the search will not go "
+                "on as it would have\n", ck.nThreads, omp_get_max_threads());
+
+        itr = ck.itr;
+        stagnantCount = ck.stagnantCount;
+        secElapsed = lastCheckpointSec = ck.secElapsed;
+        timeOrigin = get_timestamp_us() - ck.secElapsed * 1e6;
+        bestRoute = Route(this->myNodes, ck.bestHops, -1);
+        bestScore = prevBestScore = ck.bestScore;
+        best.store(packBest(bestScore, -1));
+        markBestEdges();
+        if (ck.deposits.size() != taken.size())
+            die("Checkpoint %s is damaged\n", this->myCheckpointPath.c_str());
+        deposits = ck.deposits;
+        eliteShare = ck.eliteShare;
+        eliteCut = ck.eliteCut;
+        resetPhero = ck.resetPhero;
+        totSearched = ck.totSearched;
+        totSkipped = ck.totSkipped;
+        totAudited = ck.totAudited;
+        totAuditHits = ck.totAuditHits;
+        this->myPhero = ck.phero;
+        this->myAttrFront = ck.attrFront;
+        this->myAttr[this->myAttrFront] = ck.frontAttr;
+        for (int t = 0; t < std::min(threadSeeds.size(), ck.seeds.size()); t++)
+            threadSeeds[t] = ck.seeds[t];
+
+        // The update of the iteration the checkpoint was taken in
+        #pragma omp parallel
+        {
+            const int tid = omp_get_thread_num();
+            const long nTrails = this->myTrails.size();
+            const int nThreads = omp_get_num_threads();
+            updatePheromones(nTrails * tid / nThreads, nTrails * (tid + 1) / nThreads,
+                             resetPhero, taken, deposits,
+                             threadMinPhero[tid], threadAtMin[tid]);
+        }
+
+        msg("Resumed from %s at iteration %d, best %.4f, %.1f s in\n",
+            this->myCheckpointPath.c_str(), itr, bestScore, secElapsed);
+    }
+
+    // Two sync points per iteration: the end of the ants, and the
+    // bookkeeping after it. The pheromone update does not wait for itself
+    // to finish - it writes the back attractiveness buffer while the next
+    // ants sample the front one, and the buffers swap at the next
+    // bookkeeping. Ants therefore see pheromones one iteration late.
     #pragma omp parallel
     {
-        unsigned int tseed = this->mySpec.rand_seed + omp_get_thread_num();
+        const int tid = omp_get_thread_num();
+        unsigned int tseed = threadSeeds[tid];
+        Scratch& scratch = this->myScratch[tid];
 
         while (secElapsed < this->myTimeLimSec)
         {
-            #pragma omp for
+#if COUNT_ALLOCS
+            const long allocsBefore = threadAllocCount();
+#endif
+
+            #pragma omp for schedule(dynamic) \
+                    reduction(+: nSearched, nSkipped, nAudited, nAuditHits)
             for (int i = 0; i < this->myPopSize; i++)
             {
-                Paths paths = walk(tseed);
+                Paths& paths = walk(tseed, scratch);
 
-                improvePaths(paths);
+                bool elite = true, audit = false;
+                if (eliteOn)
+                {
+                    const float built = sumPathCosts(paths);
+                    scratch.builtCosts.push_back(built);
+                    elite = built <= eliteCut;
+                    audit = !elite && jRNG::frand(tseed) < ACO_ELITE_AUDIT;
+                }
+
+                if (elite || audit)
+                    improvePaths(paths, scratch);
+
+                nSearched += elite;
+                nSkipped += !elite;
+                nAudited += audit;
 
-                const float myScore = sumPathCosts(paths);
+                const float myScore = scorePaths(paths);
 
-                #pragma omp critical
+                // Nobody reads bestHops until the ants are done, so they
+                // can be written before the swap that publishes them
+                uint64_t curr = best.load(std::memory_order_relaxed);
+                if (audit && myScore < unpackScore(curr))
+                    nAuditHits++;
+                if (myScore < unpackScore(curr))
                 {
-                    if (myScore < bestScore)
-                    {
-                        bestScore = myScore;
-                        bestRoute = Route(this->myNodes, pathToHops(paths), -1);
-                    }
+                    pathToHops(paths, scratch.bestHops);
+                    while (myScore < unpackScore(curr) &&
+                            !best.compare_exchange_weak(curr, packBest(myScore, tid)));
                 }
+                threadSeeds[tid] = tseed;
             }
 
+#if COUNT_ALLOCS
+            // Per thread over all the ants rather than per ant, as route
+            // tasks allocate on whichever thread runs them, and the tasks
+            // are all done at the end of the ants
+            threadAllocs[tid] = threadAllocCount() - allocsBefore;
+            #pragma omp barrier
+#endif
+
             #pragma omp single
             {
-                bestEdges = Edges(bestRoute.getEdges());
-                taken = makeCache(this->myDim, false);
-                currMinPhero = std::numeric_limits<float>::max();
-                nPheroAtMin = 0;
-            }
+                const uint64_t packed = best.load();
+                bestScore = unpackScore(packed);
 
-            // Find edges taken
-            #pragma omp for
-            for (int i = 0; i < bestEdges.size(); i++)
-            {
-                const Int2& edge = bestEdges[i];
-                taken[edge.x][edge.y] = (taken[edge.y][edge.x] = true);
-            }
+                currMinPhero = *std::min_element(threadMinPhero.begin(), threadMinPhero.end());
+                nPheroAtMin = 0;
+                for (const int n : threadAtMin)
+                    nPheroAtMin += n;
 
-            // Update pheromones
-            #pragma omp for reduction(min: currMinPhero) reduction(+: nPheroAtMin)
-            for (int i = 0; i < this->myTrails.size(); i++)
-            {
-                Trail& t = this->myTrails[i];
-                t.pheromone = std::max((this->myPers * t.pheromone +
-                                        (1 - this->myPers) * taken[t.n1][t.n2]),
-                                       this->myMinPhero);
-                if (t.pheromone < currMinPhero)
-                {
-                    currMinPhero = t.pheromone;
-                    nPheroAtMin = 0;
-                }
-                else if (fabs(t.pheromone - this->myMinPhero) < 0.01)
+                if (bestScore < prevBestScore)
                 {
-                    nPheroAtMin++;
+                    const Scratch& owner = this->myScratch[unpackThread(packed)];
+                    bestRoute = Route(this->myNodes, owner.bestHops, -1);
+                    markBestEdges();
                 }
-            }
 
-            #pragma omp single
-            {
                 if (bestScore == prevBestScore)
                     stagnantCount++;
                 else
@@ -486,30 +1949,163 @@ void Ants::search(Route& bestRoute, const double startTime)
 
                 itr++;
                 stagnancy = (float) stagnantCount / myMaxStag;
-                secElapsed = (get_timestamp_us() - startTime) / 1e6;
-                msg("itr %5d, best %6.4f, time %6.1f, minPhero %3.2f(%3d), stagnancy %3.1f%%\n",
-                    itr,
-                    bestScore,
-                    secElapsed,
-                    currMinPhero,
-                    this->myTrails.size() - nPheroAtMin,
-                    100.0f * stagnancy);
+                secElapsed = (get_timestamp_us() - timeOrigin) / 1e6;
+                if (this->myIsland == 0)
+                    msg("itr %5d, best %6.4f, time %6.1f, minPhero %3.2f(%3d), stagnancy %3.1f%%\n",
+                        itr,
+                        bestScore,
+                        secElapsed,
+                        currMinPhero,
+                        this->myTrails.size() - nPheroAtMin,
+                        100.0f * stagnancy);
+                else
+                    dbg("island %d: itr %5d, best %6.4f, time %6.1f, stagnancy %3.1f%%\n",
+                        this->myIsland,
+                        itr,
+                        bestScore,
+                        secElapsed,
+                        100.0f * stagnancy);
+#if COUNT_ALLOCS
+                long nAllocs = 0;
+                for (const long n : threadAllocs)
+                    nAllocs += n;
+                msg("Heap allocations by ants: %ld\n", nAllocs);
+#endif
+
+                if (eliteOn)
+                {
+                    builtCosts.clear();
+                    for (Scratch& s : this->myScratch)
+                    {
+                        builtCosts.insert(builtCosts.end(), s.builtCosts.begin(), s.builtCosts.end());
+                        s.builtCosts.clear();
+                    }
+
+                    // Widen at once when the filter is seen throwing a best
+                    // away, and narrow back slowly while it is not
+                    if (nAuditHits > 0)
+                        eliteShare = std::min(1.0f, eliteShare + ACO_ELITE_WIDEN);
+                    else
+                        eliteShare -= (eliteShare - this->myEliteShare) * ACO_ELITE_NARROW;
+
+                    const int nElite = (int) ceil(eliteShare * builtCosts.size());
+                    const float bestBuilt = *std::min_element(builtCosts.begin(), builtCosts.end());
+                    float shareCut = -std::numeric_limits<float>::max();
+                    if (nElite > 0)
+                    {
+                        std::nth_element(builtCosts.begin(), builtCosts.begin() + nElite - 1,
+                                         builtCosts.end());
+                        shareCut = builtCosts[nElite - 1];
+                    }
+                    eliteCut = std::max(shareCut, bestBuilt * (1 + this->myEliteGap));
+
+                    dbg("Elite filter: searched %ld, skipped %ld, audited %ld (%ld new best), share %.3f\n",
+                        nSearched, nSkipped, nAudited, nAuditHits, eliteShare);
+                }
+                totSearched += nSearched;
+                totSkipped += nSkipped;
+                totAudited += nAudited;
+                totAuditHits += nAuditHits;
+                nSearched = nSkipped = nAudited = nAuditHits = 0;
                 this->myStream << itr << ", "
                                << std::fixed << std::setprecision(4) << secElapsed  << ", "
                                << " " << std::fixed << std::setprecision(4) << bestScore << "\n";
+                if (this->myWriter != NULL && this->myIsland == 0)
+                {
+                    this->myWriter->appendData(this->myStream.str());
+                    this->myStream.str("");
+                }
 
+                // Trade best routes with the other islands. A better one
+                // from elsewhere becomes this colony's best, so it gets
+                // the deposits from this iteration on.
+                if (this->myIslands != NULL && itr % this->myIslands->getInterval() == 0 &&
+                        this->myIslands->migrate(this->myIsland, bestRoute.getHops(), bestScore,
+                                                 immigrant, immigrantScore))
+                {
+                    dbg("island %d: took a route of %.4f\n", this->myIsland, immigrantScore);
+                    bestRoute = Route(this->myNodes, immigrant, -1);
+                    bestScore = prevBestScore = immigrantScore;
+                    best.store(packBest(bestScore, -1));
+                    markBestEdges();
+                    stagnantCount = 0;
+                }
+
+                // Likewise with the other processes. Their score is taken
+                // again here, in case they measure distance differently.
+                if (this->myShared != NULL && itr % this->myShared->getInterval() == 0 &&
+                        this->myShared->exchange(bestRoute.getHops(), bestScore,
+                                                 immigrant, immigrantScore))
+                {
+                    Route incumbent(this->myNodes, immigrant, -1);
+                    immigrantScore = this->myDists.isExact() ?
+                                     incumbent.calcScoreWithCache(this->myDists) :
+                                     incumbent.calcScoreSerious();
+                    if (immigrantScore < bestScore)
+                    {
+                        dbg("Took a shared route of %.4f\n", immigrantScore);
+                        bestRoute = incumbent;
+                        bestScore = prevBestScore = immigrantScore;
+                        best.store(packBest(bestScore, -1));
+                        markBestEdges();
+                        stagnantCount = 0;
+                    }
+                }
 
-                if (nPheroAtMin == this->myTrails.size() - bestEdges.size() ||
-                        stagnancy == 1.0f)
+                // Pheromone figures are from the previous update
+                resetPhero = nPheroAtMin == this->myTrails.size() - taken.size() ||
+                             stagnancy == 1.0f;
+                if (resetPhero)
                 {
                     msg("Solution converged. Reinitialising pheromones...\n");
                     stagnantCount = 0;
+                }
+
+                for (int k = 0; k < taken.size(); k++)
+                    deposits[k] = resetPhero ? DEFAULT_ACO_PHEROMONE :
+                                  std::max(this->myPers * this->myPhero[taken[k]] + (1 - this->myPers),
+                                           this->myMinPhero);
+
+                this->myAttrFront = 1 - this->myAttrFront;
+
+                if (this->myWriter != NULL && bestScore < streamedScore)
+                {
+                    this->myWriter->post(bestRoute.getHops(), bestScore, itr, secElapsed);
+                    streamedScore = bestScore;
+                }
 
-                    #pragma omp simd
-                    for (int i = 0; i < this->myTrails.size(); i++)
-                        this->myTrails[i].pheromone = 1.0f;
+                if (checkpointOn && (secElapsed - lastCheckpointSec >= this->myCheckpointSec ||
+                                     secElapsed >= this->myTimeLimSec))
+                {
+                    saveCheckpoint();
+                    lastCheckpointSec = secElapsed;
                 }
             }
+
+            // Update pheromones into the back buffer, which the ants that
+            // just finished were reading. Each thread takes a fixed slice,
+            // so the deposits land after that slice's evaporation without
+            // waiting for the other threads.
+            const long nTrails = this->myTrails.size();
+            const int nThreads = omp_get_num_threads();
+            updatePheromones(nTrails * tid / nThreads, nTrails * (tid + 1) / nThreads,
+                             resetPhero, taken, deposits,
+                             threadMinPhero[tid], threadAtMin[tid]);
         }
     }
+
+    if (this->myRouteMemo.isEnabled())
+    {
+        const long lookups = this->myRouteMemo.getLookups();
+        msg("Route memo: %ld hits in %ld lookups (%.1f%%), %d routes kept, %.1f MB\n",
+            this->myRouteMemo.getHits(), lookups,
+            lookups ? 100.0 * this->myRouteMemo.getHits() / lookups : 0.0,
+            this->myRouteMemo.getCount(), this->myRouteMemo.bytes() / 1048576.0);
+    }
+
+    if (eliteOn)
+        msg("Elite filter: searched %ld of %ld ants, %ld of %ld audits of skipped ants "
+            "found a new best (%.2f%%)\n",
+            totSearched, totSearched + totSkipped, totAuditHits, totAudited,
+            totAudited ? 100.0 * totAuditHits / totAudited : 0.0);
 }
@@ -5,6 +5,13 @@
 #include "route.h"
 #include "spec.h"
 #include "savings.h"
+#include "dists.h"
+#include "fenwick.h"
+#include "route_memo.h"
+#include "islands.h"
+#include "shared_best.h"
+#include "checkpoint.h"
+#include "solution_writer.h"
 
 #define DEFAULT_ACO_ALPHA           5.0f    //importance of savings bias
 #define DEFAULT_ACO_BETA            1.0f    //importance of pheromone
@@ -12,11 +19,41 @@
 #define DEFAULT_ACO_PERSISTENCE     0.975f
 #define DEFAULT_ACO_MIN_PHERO       0.02f
 #define DEFAULT_ACO_NBHOOD_DIV      20
+#define DEFAULT_ACO_GRANULARITY     0       //savings kept per node, 0 for all
+#define DEFAULT_ACO_INTRA_MODE      INTRA_TWOOPT
+#define DEFAULT_ACO_HELD_KARP       8       //customers up to which routes are ordered exactly
+#define ACO_HELD_KARP_MAX           16      //most customers the exact ordering will take
+#define DEFAULT_ACO_ELITE_SHARE     1.0f    //share of ants given local search, 1 for all
+#define DEFAULT_ACO_ELITE_GAP       0.0f    //also search ants built this close to the best
+#define ACO_ELITE_AUDIT             0.05f   //chance a filtered ant is searched anyway
+#define ACO_ELITE_WIDEN             0.1f    //share added when an audit finds a best
+#define ACO_ELITE_NARROW            0.1f    //share of the widening undone per iteration
+#define ACO_TASK_MIN_DIM            5000    //size from which ants search their routes as tasks
+#define ACO_TASK_GRAIN              4       //routes per intra-route task
+#define ACO_ISLAND_SEED_STEP        65536   //seed offset between islands
+#define ACO_MIN_GAIN                1e-4f   //share of removed length a move must save
+#define ACO_OR_OPT_LEN              3       //longest segment Or-opt moves
+
+#define FOREACH_MOVE_KIND(MACRO) \
+    MACRO(MOVE_RELOCATE) \
+    MACRO(MOVE_TWO_OPT_STAR) \
+    MACRO(MOVE_EXCHANGE) \
+    MACRO(MOVE_CROSS)
+
+DECL_ENUM_AND_STRING(Move_Kind, FOREACH_MOVE_KIND);
+
+// Intra-route optimizer: 2-opt then Or-opt, or sequential 3-opt
+#define FOREACH_INTRA_MODE(MACRO) \
+    MACRO(INTRA_TWOOPT) \
+    MACRO(INTRA_OR3OPT)
+
+DECL_ENUM_AND_STRING(Intra_Mode, FOREACH_INTRA_MODE);
 
 class Ants
 {
 public:
     Ants(const Spec& spec,
+         const Dists& dists,
          const long popSize,
          const long maxStag,
          const float alpha,
@@ -24,9 +61,24 @@ public:
          const float pers,
          const float minPhero,
          const int nbhood,
+         const int granularity,
+         const float eliteShare,
+         const float eliteGap,
+         const Intra_Mode intraMode,
+         const int memoSlots,
+         const int heldKarp,
          std::stringstream& dataStream,
          const long timeLimSec);
     virtual ~Ants() {};
+    // Search as one of several colonies trading best routes
+    void joinIslands(Islands& islands, const int island);
+    // Search alongside other processes on this host trading best routes
+    void shareBest(SharedBest& shared);
+    // Save the search state to path every intervalSec seconds, and first
+    // carry on from the state there if resume is set
+    void checkpointTo(const String& path, const int intervalSec, const bool resume);
+    // Hand each better route, and the data series, to writer as they come
+    void streamTo(SolutionWriter& writer);
     void search(Route& bestRoute, const double startTime);
 
 private:
@@ -34,7 +86,23 @@ private:
     const long myPopSize;
     const long myMaxStag;
     const float myAlpha, myBeta, myPers, myMinPhero;
-    const int myNBHood;
+    const int myNBHood, myGranularity;
+    const float myEliteShare, myEliteGap;
+    const Intra_Mode myIntraMode;
+    const int myHeldKarp;
+    // Whether an ant's local search is split into route tasks that idle
+    // threads can take, for when there are too few ants to go round
+    const bool myRouteTasks;
+    // Intra-route results by customer set, so that a route an ant has
+    // built before is not optimised again
+    RouteMemo myRouteMemo;
+    Islands *myIslands;
+    int myIsland;
+    SharedBest *myShared;
+    String myCheckpointPath;
+    int myCheckpointSec;
+    bool myResume;
+    SolutionWriter *myWriter;
     std::stringstream& myStream;
     const long myTimeLimSec;
 
@@ -42,16 +110,26 @@ private:
     const int myDim;
     const int myVCap;
 
-    Cache<float> myDists;
+    const Dists& myDists;
 
-    typedef struct Trail : public Savings::Saving
-    {
-        Trail(const int n1val, const int n2val, const float gainVal)
-            : Saving(n1val, n2val, gainVal) {};
-        float pheromone = 1.0f;
-    } Trail;
+    typedef Savings::Saving Trail;
     typedef std::vector<Trail> Trails;
     Trails myTrails;
+    // Pheromone and the constant gain^alpha of every trail, apart from the
+    // trails so that the update streams through plain float arrays
+    Floats myPhero, myGainAttr;
+    // Trail sampling weights, double buffered: ants read the front copy
+    // while the pheromone update writes the back one
+    Floats myAttr[2];
+    int myAttrFront;
+    // Trails of each node, by trail id and by the trail's other end
+    Ints myNodeTrailStart, myNodeTrails, myEdgeTrails;
+    inline int findTrail(const int a, const int b) const;
+    inline void updateAttr();
+    inline float attr(const int i) const;
+    inline void updatePheromones(const int lo, const int hi, const bool reset,
+                                 const Ints& taken, const Floats& deposits,
+                                 float& minPhero, int& nAtMin);
 
     typedef struct Path
     {
@@ -60,12 +138,6 @@ private:
         float cost;
     } Path;
     typedef std::vector<Path> Paths;
-    inline void applyOneExchange(Paths& paths);
-    inline void applyTwoOpt(Path& path);
-    inline void applyShuffle(Path& path);
-    inline void improvePaths(Paths& paths);
-    inline Ints pathToHops(const Paths &paths);
-    inline float sumPathCosts(const Paths &paths);
 
     typedef struct WayPoint
     {
@@ -74,9 +146,113 @@ private:
         struct WayPoint *otherEnd;
     } WayPoint;
     typedef std::vector<WayPoint> WayPoints;
-    inline Paths wayPointsToPaths(WayPoints localWayPoints);
-    inline WayPoints applySavings(unsigned int& seed, Trails lclTrails);
-    inline Paths walk(unsigned int& seed);
+
+    // What a route's customers span, leaving out the depot that every
+    // route shares, and how far the depot is from that box
+    typedef struct RouteBox
+    {
+        float minX, minY, maxX, maxY;
+        float depotGap;
+    } RouteBox;
+
+    // An inter-route move for customer u and its neighbour v, described
+    // by nodes rather than positions so that it stays meaningful while
+    // the routes around it change, and what it gained when last priced
+    typedef struct Move
+    {
+        float gain;
+        Move_Kind kind;
+        int u, v;
+        int len1, len2;     //after v or not, or the two segment lengths
+        int full;           //route it would overload, or -1
+        float fitLoad;      //load that route must come down to
+        int via, epoch;     //whose neighbours it came from, and when
+
+        bool operator < (const Move& m) const
+        {
+            return gain < m.gain;
+        }
+    } Move;
+
+    // Buffers owned by one thread and reused by every ant it runs, so
+    // that once they have grown a walk allocates nothing
+    typedef struct Scratch
+    {
+        WayPoints wayPoints;
+        Fenwick<double> weights;
+        std::vector<char> live;
+        Ints entered;       //trails the last walk added to weights
+        Paths paths;
+        std::vector<Ints> spareHops;
+        Ints bestHops;      //last route this thread offered as the best
+        Floats builtCosts;  //cost of each ant as built, this iteration
+
+        // One route as a cycle through the depot, each node's position in
+        // it (valid where routeStamp matches stamp) and a don't-look queue
+        Ints tour, pos, routeStamp, queue;
+        std::vector<char> queued;
+        int stamp = 0;
+
+        // Held-Karp: distances between a short route's customers, by
+        // destination, then from the depot, and the table of best paths
+        Floats hkDists, hkTable;
+
+        // Inter-route search: each customer's route (and position), the
+        // round in which its pairs were last priced, how far away a
+        // neighbour can be and still be worth pricing a move with, the
+        // move heap and the moves waiting on each full route, prefix loads
+        // and the box of each route, the routes changed in this round
+        // (flagged) and those the round started with, and room for the
+        // segments a move swaps
+        Ints routeOf, evalEpoch;
+        int epoch = 0;
+        Floats reach;
+        std::vector<Move> moves;
+        std::vector<std::vector<Move>> parked;
+        std::vector<Floats> prefLoad;
+        std::vector<RouteBox> boxes;
+        Ints dirty, round;
+        std::vector<char> isDirty;
+        Ints segA, segB;
+
+        // Route pairs worth searching together, as (first, second, their
+        // versions when last searched), and the routes' versions
+        Ints routePairs, pairsNext, routeVersion, batch;
+        std::vector<char> busy;
+    } Scratch;
+    std::vector<Scratch> myScratch;
+
+    inline void indexRoute(Path& path, const int r, Scratch& scratch);
+    inline void indexRoutes(Paths& paths, Scratch& scratch);
+    inline void dropEmptyPaths(Paths& paths, Scratch& scratch);
+    inline void priceMove(const Paths& paths, Move& m, const Scratch& scratch);
+    inline void queueMove(const Move& m, Scratch& scratch);
+    inline void evalPair(const Paths& paths, const int u, const int v, const int via,
+                         Scratch& scratch);
+    inline void evalRoute(const Paths& paths, const int r, Scratch& scratch);
+    inline void applyMove(Paths& paths, const Move& m, Scratch& scratch);
+    static inline void markDirty(const int r, Scratch& scratch);
+    inline bool drainMoves(Paths& paths, Scratch& scratch);
+    inline bool improveRoutes(Paths& paths, Scratch& scratch);
+    inline bool improveRoutePair(Paths& paths, const int r1, const int r2, Scratch& scratch);
+    inline bool findRoutePairs(Paths& paths, Scratch& scratch);
+    inline bool improveRoutesInTasks(Paths& paths, Scratch& scratch);
+    static inline bool isGain(const float gain, const float removed);
+    static inline float boxGap(const RouteBox& a, const RouteBox& b);
+    inline void applyTwoOpt(Path& path, Scratch& scratch);
+    inline void applyOrOpt(Path& path, Scratch& scratch);
+    inline void applyOrThreeOpt(Path& path, Scratch& scratch);
+    inline void applyHeldKarp(Path& path, Scratch& scratch);
+    inline void improvePath(Path& path, Scratch& scratch);
+    inline void improvePaths(Paths& paths, Scratch& scratch);
+    inline void improvePathsInTasks(Paths& paths, Scratch& scratch);
+    inline void pathToHops(const Paths &paths, Ints& hops);
+    inline float sumPathCosts(const Paths &paths);
+    inline float scorePaths(const Paths &paths);
+
+    inline void wayPointsToPaths(Scratch& scratch);
+    inline void applySavings(unsigned int& seed, Scratch& scratch);
+    inline Paths& walk(unsigned int& seed, Scratch& scratch);
 };
 
 #endif /* include guard */
\ No newline at end of file
@@ -15,6 +15,7 @@ namespace BasicExchange
 
 void search(Route& bestRoute,
             const Spec& spec,
+            const Dists& dists,
             std::stringstream& dataStream,
             double startTime)
 {
@@ -23,8 +24,6 @@ void search(Route& bestRoute,
     const int vcap = spec.getVCap();
     int itr = 0;
 
-    Cache<float> myDists = Score::makeScoreCache(spec.getNodes(), Score::real);
-
     Ints sol = Route::genAscendHops(dim);
     float bestScore = std::numeric_limits<float>::max();
     int maxStag = 20, stag = 0;
@@ -45,16 +44,16 @@ void search(Route& bestRoute,
                 Ints newSol1 = Ints(sol.begin(), sol.end());
                 newSol1.insert(newSol1.begin() + j, node1);
                 newSol1.erase(newSol1.begin() + i);
-                const float c1 = Route(nodes, sol, vcap).calcScoreWithCache(myDists);
+                const float c1 = Route(nodes, sol, vcap).calcScoreWithCache(dists);
                 Route newRoute1 = Route(nodes, newSol1, vcap);
-                const float c2 = newRoute1.calcScoreWithCache(myDists);
+                const float c2 = newRoute1.calcScoreWithCache(dists);
 
                 // Could putting node j in position i make a better route? (i < j)
                 Ints newSol2 = Ints(sol.begin(), sol.end());
                 newSol2.erase(newSol2.begin() + j);
                 newSol2.insert(newSol2.begin() + i, node2);
                 Route newRoute2 = Route(nodes, newSol2, vcap);
-                const float c3 = newRoute2.calcScoreWithCache(myDists);
+                const float c3 = newRoute2.calcScoreWithCache(dists);
 
                 bestScore = std::min(std::min(c1, c2), c3);
                 if (bestScore == c2)
@@ -82,7 +81,7 @@ void search(Route& bestRoute,
                 std::reverse(newSol.begin() + i, newSol.begin() + j + 1);
 
                 const Route newRoute = Route(nodes, newSol, vcap);
-                const float newScore = newRoute.calcScoreWithCache(myDists);
+                const float newScore = newRoute.calcScoreWithCache(dists);
                 if ( newScore < bestScore )
                 {
                     stag = 0;
@@ -4,12 +4,14 @@
 
 #include "spec.h"
 #include "route.h"
+#include "dists.h"
 
 namespace BasicExchange
 {
 
 void search(Route& bestRoute,
             const Spec& spec,
+            const Dists& dists,
             std::stringstream& dataStream,
             double startTime);
 
@@ -14,13 +14,12 @@ namespace BasicRandom
 
 void search(Route& bestRoute,
             const Spec& spec,
+            const Dists& dists,
             const long populationSize,
             std::stringstream& dataStream)
 {
     float bestScore = std::numeric_limits<float>::max();
 
-    Cache<float> realDists = Score::makeScoreCache(spec.getNodes(), Score::real);
-
     #pragma omp parallel
     {
         unsigned int tseed = spec.rand_seed + omp_get_thread_num();
@@ -32,7 +31,7 @@ void search(Route& bestRoute,
             Route r = Route(spec.getNodes(), spec.getVCap(), tseed);
 
             //evaluate route
-            const float myScore = r.calcScoreWithCache(realDists);
+            const float myScore = r.calcScoreWithCache(dists);
 
             #pragma omp critical
             {
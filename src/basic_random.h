@@ -4,12 +4,14 @@
 
 #include "spec.h"
 #include "route.h"
+#include "dists.h"
 
 namespace BasicRandom
 {
 
 void search(Route& bestRoute,
             const Spec& spec,
+            const Dists& dists,
             const long populationSize,
             std::stringstream& dataStream);
 
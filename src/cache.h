@@ -1,28 +1,109 @@
 #ifndef _CACHE_H_
 #define _CACHE_H_
 
-template<typename T>
-using CacheRow = std::vector<T>;
-template<typename T>
-using Cache = std::vector<CacheRow<T>>;
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+#include "config.h"
 
+#if CACHE_HUGE_PAGES && defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Flat, row-major N x N matrix. Rows are padded so that every row starts on
+// a cache line, and C[i][j] is a single offset from one contiguous block.
 template<typename T>
-Cache<T> makeCache(const int N, T val)
+class Cache
 {
-    Cache<T> C;
-    C.reserve(N);
-    for (int i = 0; i < N; i++)
+public:
+    Cache() : myDim(0), myStride(0), myData(NULL) {};
+    // Uninitialised - pages are first touched by whoever fills them
+    explicit Cache(const int N)
+        : myDim(N), myStride(calcStride(N)), myData(NULL)
+    {
+        allocate();
+    };
+    Cache(const int N, const T val)
+        : myDim(N), myStride(calcStride(N)), myData(NULL)
+    {
+        allocate();
+        std::fill(myData, myData + (size_t) myDim * myStride, val);
+    };
+    Cache(const Cache& other)
+        : myDim(other.myDim), myStride(other.myStride), myData(NULL)
+    {
+        allocate();
+        memcpy(myData, other.myData, bytes());
+    };
+    Cache(Cache&& other)
+        : myDim(other.myDim), myStride(other.myStride), myData(other.myData)
+    {
+        other.myDim = 0;
+        other.myStride = 0;
+        other.myData = NULL;
+    };
+    Cache& operator=(Cache other)
+    {
+        std::swap(myDim, other.myDim);
+        std::swap(myStride, other.myStride);
+        std::swap(myData, other.myData);
+        return *this;
+    };
+    ~Cache() { free(myData); };
+
+    inline T *operator[](const int i)
     {
-        CacheRow<T> R;
-        R.reserve(N);
+        return myData + (size_t) i * myStride;
+    };
+    inline const T *operator[](const int i) const
+    {
+        return myData + (size_t) i * myStride;
+    };
+
+    int size() const { return myDim; };
+    size_t stride() const { return myStride; };
+    size_t bytes() const { return (size_t) myDim * myStride * sizeof(T); };
+
+private:
+    int myDim;
+    size_t myStride;
+    T *myData;
 
-        for (int j = 0; j < N; j++)
-            R.push_back(val);
+    static size_t calcStride(const int N)
+    {
+        const size_t perLine = CACHE_LINE_BYTES / sizeof(T);
+        return perLine == 0 ? N : (N + perLine - 1) / perLine * perLine;
+    };
+
+    void allocate()
+    {
+        if (bytes() == 0)
+            return;
 
-        C.push_back(R);
-    }
+        size_t align = CACHE_LINE_BYTES;
+#if CACHE_HUGE_PAGES && defined(__linux__)
+        if (bytes() >= CACHE_HUGE_PAGE_BYTES)
+            align = CACHE_HUGE_PAGE_BYTES;
+#endif
 
-    return C;
+        void *p = NULL;
+        if (posix_memalign(&p, align, bytes()))
+            throw std::bad_alloc();
+        myData = static_cast<T *>(p);
+
+#if CACHE_HUGE_PAGES && defined(__linux__)
+        if (align == CACHE_HUGE_PAGE_BYTES)
+            madvise(p, bytes(), MADV_HUGEPAGE);
+#endif
+    };
+};
+
+template<typename T>
+Cache<T> makeCache(const int N, T val)
+{
+    return Cache<T>(N, val);
 }
 
-#endif /* include guard */
\ No newline at end of file
+#endif /* include guard */
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "util.h"
+
+static const char CHECKPOINT_MAGIC[8] = {'J', 'A', 'N', 'T', 'S', 'C', 'P', '1'};
+
+template <typename T>
+static inline bool put(FILE *f, const T& val)
+{
+    return fwrite(&val, sizeof(T), 1, f) == 1;
+}
+
+template <typename T>
+static inline bool put(FILE *f, const std::vector<T>& vec)
+{
+    const uint64_t n = vec.size();
+    return put(f, n) && fwrite(vec.data(), sizeof(T), n, f) == n;
+}
+
+template <typename T>
+static inline bool get(FILE *f, T& val)
+{
+    return fread(&val, sizeof(T), 1, f) == 1;
+}
+
+template <typename T>
+static inline bool get(FILE *f, std::vector<T>& vec)
+{
+    uint64_t n;
+    if (!get(f, n) || n > (1ULL << 32))
+        return false;
+    vec.resize(n);
+    return fread(vec.data(), sizeof(T), n, f) == n;
+}
+
+bool Checkpoint::save(const String& path) const
+{
+    const String tmpPath = path + ".tmp";
+    FILE *f = fopen(tmpPath.c_str(), "wb");
+    if (f == NULL)
+    {
+        wrn("Cannot write checkpoint %s: %s\n", tmpPath.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool ok = fwrite(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC), 1, f) == 1 &&
+              put(f, key) && put(f, nTrails) && put(f, nThreads) && put(f, settings) &&
+              put(f, itr) && put(f, attrFront) &&
+              put(f, stagnantCount) && put(f, secElapsed) &&
+              put(f, bestScore) && put(f, eliteShare) && put(f, eliteCut) &&
+              put(f, resetPhero) &&
+              put(f, totSearched) && put(f, totSkipped) && put(f, totAudited) && put(f, totAuditHits) &&
+              put(f, bestHops) && put(f, phero) && put(f, frontAttr) && put(f, deposits) &&
+              put(f, seeds);
+
+    // On disk before it replaces the last one
+    ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        wrn("Cannot write checkpoint %s: %s\n", path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool Checkpoint::load(const String& path)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == NULL)
+    {
+        wrn("Cannot read checkpoint %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    bool ok = fread(magic, sizeof(magic), 1, f) == 1 &&
+              memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0 &&
+              get(f, key) && get(f, nTrails) && get(f, nThreads) && get(f, settings) &&
+              get(f, itr) && get(f, attrFront) &&
+              get(f, stagnantCount) && get(f, secElapsed) &&
+              get(f, bestScore) && get(f, eliteShare) && get(f, eliteCut) &&
+              get(f, resetPhero) &&
+              get(f, totSearched) && get(f, totSkipped) && get(f, totAudited) && get(f, totAuditHits) &&
+              get(f, bestHops) && get(f, phero) && get(f, frontAttr) && get(f, deposits) &&
+              get(f, seeds);
+    ok = ok && fgetc(f) == EOF;
+    fclose(f);
+
+    if (!ok)
+        wrn("Checkpoint %s is damaged or not a checkpoint\n", path.c_str());
+    return ok;
+}
@@ -0,0 +1,39 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include "typedefs.h"
+
+#define DEFAULT_CHECKPOINT_SEC      300     //seconds between checkpoints
+
+// The search state of Ants::search at the end of an iteration's
+// bookkeeping, which is all it needs to carry on from there: the
+// pheromones and the sampling weights the next ants read, the best route
+// and the deposits its trails are due, each thread's RNG seed and the
+// counters. Kept in a little binary file that is written to a temporary
+// name and renamed over the last one, so a crash mid-write leaves the
+// previous checkpoint whole.
+typedef struct Checkpoint
+{
+    uint64_t key;               //instance fingerprint
+    int nTrails, nThreads;
+    Floats settings;            //ACO settings the pheromones were laid with
+
+    int itr, attrFront;
+    long stagnantCount;
+    double secElapsed;
+    float bestScore, eliteShare, eliteCut;
+    int resetPhero;
+    long totSearched, totSkipped, totAudited, totAuditHits;
+
+    Ints bestHops;
+    Floats phero, frontAttr, deposits;
+    std::vector<unsigned int> seeds;
+
+    // Both false with a warning on failure
+    bool save(const String& path) const;
+    bool load(const String& path);
+} Checkpoint;
+
+#endif /* include guard */
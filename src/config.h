@@ -5,12 +5,23 @@
 #define ITERATION_PRINT_SAMPLES     10
 #endif
 
+#ifndef CACHE_HUGE_PAGES
+#define CACHE_HUGE_PAGES            0       //back large caches with huge pages
+#endif
+
+#ifndef COUNT_ALLOCS
+#define COUNT_ALLOCS                0       //count heap allocations per thread
+#endif
+
+#define CACHE_LINE_BYTES            64
+#define CACHE_HUGE_PAGE_BYTES       (2 << 20)
+
 #define DEFAULT_LOG_LEVEL           LOG_WARN
 #define DEFAULT_RAND_SEED           0xdeadbeef
 #define DEFAULT_INPUT_FILE          "res/fruitybun250_2016.vrp"
 #define DEFAULT_OUTPUT_FILE         "last-solution.txt"
 #define DEFAULT_DATA_OUTPUT_FILE    "data.txt"
-#define DEFAULT_GRID_OUTPUT_FILE    "grid.txt"
+#define DEFAULT_RACE_OUTPUT_FILE    "race.txt"
 #define DEFAULT_POPULATION_SIZE     128
 #define DEFAULT_MAX_STAGNANCY       150
 #define DEFAULT_TIME_LIMIT_SEC      (60 * 999999) //some large number
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <utility>
+#include <limits>
+
+#include "dists.h"
+#include "score.h"
+#include "util.h"
+
+Dists::Dists(const Nodes& nodes, const Dists_Mode mode, const int nNbrs)
+    : myNodes(&nodes), myDim(nodes.size()), myMode(pickMode(mode, myDim)),
+      myNbrCount(std::max(0, std::min(nNbrs, myDim - 2)))
+{
+    const double startTime = get_timestamp_us();
+
+    buildNbrs();
+
+    if (this->myMode == DISTS_QUANT16 && !quantise())
+        this->myMode = DISTS_DENSE;
+
+    switch (this->myMode)
+    {
+    case DISTS_DENSE:
+        this->myDense = Score::makeRealCache(nodes);
+        break;
+    case DISTS_PACKED:
+        this->myTri = Score::makeRealTriangle(nodes);
+        this->myTriBase = std::vector<size_t>(this->myDim);
+        for (size_t i = 0; i < this->myDim; i++)
+            this->myTriBase[i] = i * this->myDim - i * (i + 1) / 2;
+        break;
+    case DISTS_SPARSE:
+        this->myDepotDists = Floats(this->myDim);
+        for (int i = 0; i < this->myDim; i++)
+            this->myDepotDists[i] = calc(0, i);
+        break;
+    case DISTS_QUANT16:
+        this->myQuant = Score::makeQuantCache(nodes, this->myQuantStep);
+        break;
+    default:
+        die("Unknown distance mode: %s\n", Dists_Mode_String[this->myMode]);
+    }
+
+    msg("Distances: %s, %d neighbours per node, %.1f MB in %.2fs\n",
+        Dists_Mode_String[this->myMode],
+        this->myNbrCount,
+        bytes() / 1048576.0,
+        (get_timestamp_us() - startTime) / 1e6);
+}
+
+Dists_Mode Dists::pickMode(const Dists_Mode mode, const int dim)
+{
+    if (mode != DISTS_AUTO)
+        return mode;
+
+    return dim >= DEFAULT_DISTS_SPARSE_DIM ? DISTS_SPARSE : DISTS_DENSE;
+}
+
+int Dists::size() const
+{
+    return this->myDim;
+}
+
+Dists_Mode Dists::getMode() const
+{
+    return this->myMode;
+}
+
+bool Dists::isSparse() const
+{
+    return this->myMode == DISTS_SPARSE;
+}
+
+bool Dists::isExact() const
+{
+    return this->myMode != DISTS_QUANT16;
+}
+
+// Pick the quantisation step so the bounding box diagonal fits in 16 bits,
+// then measure the error on the nearest neighbour edges, which are the ones
+// good routes are made of. Returns false if that error is too large.
+bool Dists::quantise()
+{
+    const Nodes& nodes = *this->myNodes;
+    float minX = std::numeric_limits<float>::max(), minY = minX;
+    float maxX = -minX, maxY = -minX;
+    for (const Node& n : nodes)
+    {
+        minX = std::min(minX, n.x);
+        minY = std::min(minY, n.y);
+        maxX = std::max(maxX, n.x);
+        maxY = std::max(maxY, n.y);
+    }
+
+    const double diag = sqrt((double) (maxX - minX) * (maxX - minX) +
+                             (double) (maxY - minY) * (maxY - minY));
+    this->myQuantStep = std::max(diag / UINT16_MAX, 1e-9);
+
+    double sumRelErr = 0.0;
+    size_t nEdges = 0;
+    for (size_t i = 0; i < this->myNbrDists.size(); i++)
+    {
+        const float d = this->myNbrDists[i];
+        if (d <= 0.0f)
+            continue;
+
+        const double err = fabs(lround(d / this->myQuantStep) * this->myQuantStep - d);
+        sumRelErr += err / d;
+        nEdges++;
+    }
+
+    const double meanRelErr = nEdges ? sumRelErr / nEdges : 0.0;
+    msg("Quantisation step %.4f (error <= %.4f), mean relative error %.2e on %lu short edges\n",
+        this->myQuantStep, this->myQuantStep / 2, meanRelErr, nEdges);
+
+    if (meanRelErr > DISTS_QUANT_MAX_REL_ERR)
+    {
+        wrn("16-bit distances too lossy for this coordinate range, using float\n");
+        return false;
+    }
+
+    return true;
+}
+
+size_t Dists::bytes() const
+{
+    return this->myDense.bytes() +
+           this->myQuant.bytes() +
+           this->myTri.size() * sizeof(float) +
+           this->myTriBase.size() * sizeof(size_t) +
+           this->myDepotDists.size() * sizeof(float) +
+           this->myNbrs.size() * sizeof(int) +
+           this->myNbrDists.size() * sizeof(float);
+}
+
+int Dists::getNbrCount() const
+{
+    return this->myNbrCount;
+}
+
+// Bucket customers into a uniform grid and search outwards ring by ring
+// until the k-th best found is closer than anything an outer ring can hold.
+void Dists::buildNbrs()
+{
+    const int N = this->myDim;
+    const int K = this->myNbrCount;
+    this->myNbrs = Ints((size_t) N * K);
+    this->myNbrDists = Floats((size_t) N * K);
+
+    if (K == 0)
+        return;
+
+    const Nodes& nodes = *this->myNodes;
+    float minX = std::numeric_limits<float>::max(), minY = minX;
+    float maxX = -minX, maxY = -minX;
+    for (int i = 0; i < N; i++)
+    {
+        minX = std::min(minX, nodes[i].x);
+        minY = std::min(minY, nodes[i].y);
+        maxX = std::max(maxX, nodes[i].x);
+        maxY = std::max(maxY, nodes[i].y);
+    }
+
+    const int G = std::max(1, (int) sqrt((N - 1) / 2.0));
+    const float cellW = std::max(std::max(maxX - minX, maxY - minY) / G, 1e-6f);
+    auto cellOf = [&](const float v, const float lo)
+    {
+        return std::min(G - 1, (int) ((v - lo) / cellW));
+    };
+
+    // Counting sort of customers into cells
+    Ints cellStart(G * G + 1, 0), cellItems(N - 1);
+    for (int i = 1; i < N; i++)
+        cellStart[cellOf(nodes[i].y, minY) * G + cellOf(nodes[i].x, minX) + 1]++;
+    for (int c = 0; c < G * G; c++)
+        cellStart[c + 1] += cellStart[c];
+    Ints fill(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 1; i < N; i++)
+        cellItems[fill[cellOf(nodes[i].y, minY) * G + cellOf(nodes[i].x, minX)]++] = i;
+
+    #pragma omp parallel
+    {
+        std::vector<std::pair<float, int>> heap;
+        heap.reserve(K + 1);
+
+        #pragma omp for schedule(dynamic, 64)
+        for (int i = 0; i < N; i++)
+        {
+            heap.clear();
+            const int cx = cellOf(nodes[i].x, minX), cy = cellOf(nodes[i].y, minY);
+
+            auto scanCell = [&](const int x, const int y)
+            {
+                if (x < 0 || x >= G || y < 0 || y >= G)
+                    return;
+
+                const int c = y * G + x;
+                for (int t = cellStart[c]; t < cellStart[c + 1]; t++)
+                {
+                    const int j = cellItems[t];
+                    if (j == i)
+                        continue;
+
+                    const float d = calc(i, j);
+                    if ((int) heap.size() < K)
+                    {
+                        heap.emplace_back(d, j);
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                    else if (d < heap.front().first)
+                    {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.back() = std::make_pair(d, j);
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                }
+            };
+
+            for (int r = 0; r < G; r++)
+            {
+                // Cells at Chebyshev distance r from (cx, cy)
+                for (int x = cx - r; x <= cx + r; x++)
+                {
+                    scanCell(x, cy - r);
+                    if (r > 0)
+                        scanCell(x, cy + r);
+                }
+                for (int y = cy - r + 1; y <= cy + r - 1; y++)
+                {
+                    scanCell(cx - r, y);
+                    scanCell(cx + r, y);
+                }
+
+                if ((int) heap.size() == K && heap.front().first <= r * cellW)
+                    break;
+            }
+
+            std::sort_heap(heap.begin(), heap.end());
+            for (int k = 0; k < K; k++)
+            {
+                this->myNbrs[(size_t) i * K + k] = heap[k].second;
+                this->myNbrDists[(size_t) i * K + k] = heap[k].first;
+            }
+        }
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef _DISTS_H_
+#define _DISTS_H_
+
+#include <cmath>
+#include <stdint.h>
+
+#include "typedefs.h"
+#include "node.h"
+#include "cache.h"
+#include "util.h"
+
+#define DEFAULT_DISTS_NBRS          32      //nearest neighbours kept per node
+#define DEFAULT_DISTS_SPARSE_DIM    10000   //go sparse at this many nodes
+#define DISTS_QUANT_MAX_REL_ERR     1e-3f   //worst mean error on short edges
+
+#define FOREACH_DISTS_MODE(MACRO) \
+    MACRO(DISTS_AUTO) \
+    MACRO(DISTS_DENSE) \
+    MACRO(DISTS_PACKED) \
+    MACRO(DISTS_SPARSE) \
+    MACRO(DISTS_QUANT16)
+
+DECL_ENUM_AND_STRING(Dists_Mode, FOREACH_DISTS_MODE);
+
+// Distance provider. Small instances keep a dense N x N matrix (or only its
+// packed upper triangle, or a 16-bit quantised copy); large ones keep only
+// each node's k nearest neighbours and its depot distance, and compute every
+// other pair from the coordinates on demand.
+class Dists
+{
+public:
+    Dists(const Nodes& nodes,
+          const Dists_Mode mode = DISTS_AUTO,
+          const int nNbrs = DEFAULT_DISTS_NBRS);
+    virtual ~Dists() {};
+
+    class Row
+    {
+    public:
+        Row(const Dists& dists, const int i) : myDists(dists), myI(i) {};
+        inline float operator[](const int j) const
+        {
+            return myDists.get(myI, j);
+        };
+    private:
+        const Dists& myDists;
+        const int myI;
+    };
+
+    inline Row operator[](const int i) const
+    {
+        return Row(*this, i);
+    };
+
+    inline float get(const int a, const int b) const
+    {
+        switch (this->myMode)
+        {
+        case DISTS_DENSE:
+            return this->myDense[a][b];
+        case DISTS_QUANT16:
+            return this->myQuant[a][b] * this->myQuantStep;
+        case DISTS_PACKED:
+            return a < b ? this->myTri[this->myTriBase[a] + b] :
+                   this->myTri[this->myTriBase[b] + a];
+        default:
+            if (a == 0)
+                return this->myDepotDists[b];
+            if (b == 0)
+                return this->myDepotDists[a];
+            return calc(a, b);
+        }
+    };
+
+    // Same value as Score::real, without going through pow()
+    inline float calc(const int a, const int b) const
+    {
+        const Node& p1 = (*this->myNodes)[a];
+        const Node& p2 = (*this->myNodes)[b];
+        const double dx = p2.x - p1.x, dy = p2.y - p1.y;
+        return sqrt((float) (dx * dx + dy * dy));
+    };
+
+    int size() const;
+    Dists_Mode getMode() const;
+    bool isSparse() const;
+    bool isExact() const;
+    size_t bytes() const;
+
+    // Nearest customers of node i in ascending distance (depot excluded)
+    int getNbrCount() const;
+    inline const int *getNbrs(const int i) const
+    {
+        return &this->myNbrs[(size_t) i * this->myNbrCount];
+    };
+    inline const float *getNbrDists(const int i) const
+    {
+        return &this->myNbrDists[(size_t) i * this->myNbrCount];
+    };
+
+private:
+    const Nodes *myNodes;
+    const int myDim;
+    Dists_Mode myMode;
+    int myNbrCount;
+
+    Cache<float> myDense;
+    Cache<uint16_t> myQuant;
+    float myQuantStep = 0.0f;
+    Floats myTri;
+    std::vector<size_t> myTriBase;
+    Floats myDepotDists;
+    Ints myNbrs;
+    Floats myNbrDists;
+
+    void buildNbrs();
+    bool quantise();
+    static Dists_Mode pickMode(const Dists_Mode mode, const int dim);
+};
+
+#endif /* include guard */
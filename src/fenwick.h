@@ -0,0 +1,81 @@
+#ifndef _FENWICK_H_
+#define _FENWICK_H_
+
+#include <vector>
+
+// Binary indexed tree over n values: point updates, prefix sums and
+// "first index whose prefix sum reaches x" all in O(log n).
+template<typename T>
+class Fenwick
+{
+public:
+    Fenwick() : mySize(0), myTopBit(0) {};
+    virtual ~Fenwick() {};
+
+    // All n values zero, reusing storage when it is large enough
+    void reset(const int n)
+    {
+        mySize = n;
+        myTree.assign(n + 1, 0);
+        myTopBit = 1;
+        while (myTopBit * 2 <= n)
+            myTopBit *= 2;
+    };
+
+    // All values zero again, given every index that was added to since:
+    // only the nodes over those are zeroed, unless that would touch more
+    // nodes than a reset does
+    void zero(const std::vector<int>& added)
+    {
+        int depth = 0;
+        for (int bit = myTopBit; bit > 0; bit >>= 1)
+            depth++;
+        if ((long) added.size() * depth > mySize)
+        {
+            reset(mySize);
+            return;
+        }
+
+        for (int i : added)
+            for (i++; i <= mySize; i += i & -i)
+                myTree[i] = 0;
+    };
+
+    inline void add(int i, const T delta)
+    {
+        for (i++; i <= mySize; i += i & -i)
+            myTree[i] += delta;
+    };
+
+    // Sum of values [0, i]
+    inline T prefix(int i) const
+    {
+        T sum = 0;
+        for (i++; i > 0; i -= i & -i)
+            sum += myTree[i];
+        return sum;
+    };
+
+    // Smallest i with prefix(i) >= target, or size() if there is none
+    inline int lowerBound(T target) const
+    {
+        int pos = 0;
+        for (int step = myTopBit; step > 0; step >>= 1)
+        {
+            if (pos + step <= mySize && myTree[pos + step] < target)
+            {
+                pos += step;
+                target -= myTree[pos];
+            }
+        }
+        return pos;
+    };
+
+    int size() const { return mySize; };
+
+private:
+    std::vector<T> myTree;
+    int mySize, myTopBit;
+};
+
+#endif /* include guard */
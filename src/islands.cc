@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <limits>
+
+#include "islands.h"
+
+Islands::Islands(const int nIslands, const Migration topology, const int interval)
+    : myBoxes(nIslands), myTopology(topology), myInterval(std::max(interval, 1))
+{
+    for (Mailbox& box : this->myBoxes)
+    {
+        omp_init_lock(&box.lock);
+        box.score = std::numeric_limits<float>::max();
+    }
+}
+
+Islands::~Islands()
+{
+    for (Mailbox& box : this->myBoxes)
+        omp_destroy_lock(&box.lock);
+}
+
+int Islands::size() const
+{
+    return this->myBoxes.size();
+}
+
+int Islands::getInterval() const
+{
+    return this->myInterval;
+}
+
+bool Islands::migrate(const int island, const Ints& hops, const float score,
+                      Ints& inHops, float& inScore)
+{
+    const int n = this->myBoxes.size();
+
+    Mailbox& own = this->myBoxes[island];
+    omp_set_lock(&own.lock);
+    if (score < own.score)
+    {
+        own.hops.assign(hops.begin(), hops.end());
+        own.score = score;
+    }
+    omp_unset_lock(&own.lock);
+
+    bool found = false;
+    inScore = score;
+    for (int k = 1; k < n; k++)
+    {
+        if (this->myTopology == MIGRATE_RING && k > 1)
+            break;
+
+        Mailbox& box = this->myBoxes[(island - k + n) % n];
+        omp_set_lock(&box.lock);
+        if (box.score < inScore)
+        {
+            inHops.assign(box.hops.begin(), box.hops.end());
+            inScore = box.score;
+            found = true;
+        }
+        omp_unset_lock(&box.lock);
+    }
+
+    return found;
+}
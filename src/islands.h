@@ -0,0 +1,52 @@
+#ifndef _ISLANDS_H_
+#define _ISLANDS_H_
+
+#include <vector>
+
+#include "typedefs.h"
+#include "util.h"
+#include "omp.h"
+
+#define DEFAULT_ISLANDS             1       //colonies searched side by side
+#define DEFAULT_MIGRATION_INTERVAL  20      //iterations between migrations
+
+// Which islands each island takes routes from: the one before it in a
+// ring, or all of them
+#define FOREACH_MIGRATION(MACRO) \
+    MACRO(MIGRATE_RING) \
+    MACRO(MIGRATE_ALL)
+
+DECL_ENUM_AND_STRING(Migration, FOREACH_MIGRATION);
+
+// Mailboxes through which colonies searching side by side trade their
+// best routes. Each island posts to its own box and reads from the
+// boxes the topology lets it hear from, whenever it gets round to it,
+// so no island waits on another.
+class Islands
+{
+public:
+    Islands(const int nIslands, const Migration topology, const int interval);
+    virtual ~Islands();
+
+    int size() const;
+    int getInterval() const;
+
+    // Posts island's best route, and fetches into inHops the best route
+    // of the islands it hears from if that beats score
+    bool migrate(const int island, const Ints& hops, const float score,
+                 Ints& inHops, float& inScore);
+
+private:
+    typedef struct Mailbox
+    {
+        omp_lock_t lock;
+        Ints hops;
+        float score;
+    } Mailbox;
+
+    std::vector<Mailbox> myBoxes;
+    const Migration myTopology;
+    const int myInterval;
+};
+
+#endif /* include guard */
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sstream>
 #include <stdio.h>
 #include <unistd.h>
@@ -7,6 +8,8 @@
 #include <iomanip>
 #include <algorithm>
 #include <iostream>
+#include <deque>
+#include <limits>
 
 #include "config.h"
 #include "typedefs.h"
@@ -17,13 +20,19 @@
 #include "route.h"
 #include "output_writer.h"
 #include "ants.h"
+#include "islands.h"
+#include "shared_best.h"
+#include "checkpoint.h"
+#include "solution_writer.h"
+#include "race.h"
 #include "basic_exchange.h"
 #include "divine.h"
+#include "dists.h"
 
 const argument_format af_help       = {"-h", "--help", 0, "Print help message"};
 const argument_format af_brand      = {"-br", "--basicrand", 0, "Do basic random search"};
 const argument_format af_exc        = {"-ex", "--exchange", 0, "Do basic exchange search"};
-const argument_format af_grid       = {"-gr", "--grid", 2, "Do grid search on ACO with index range"};
+const argument_format af_race       = {"-rc", "--race", 1, "Race ACO configurations from a config file"};
 
 const argument_format af_loglv      = {"-lg", "--loglv", 1, "Set log level {0-4}"};
 const argument_format af_input      = {"-i", "--input", 1, "Set input file"};
@@ -38,6 +47,22 @@ const argument_format af_beta       = {"-b", "--beta", 1, "Set importance of phe
 const argument_format af_pers       = {"-ps", "--persistence", 1, "Set persistence of pheromone in ACO"};
 const argument_format af_nbh        = {"-nd", "--nbhooddiv", 1, "Set nbhood divisor in ACO"};
 const argument_format af_mnph       = {"-mnp", "--minphero", 1, "Set min pheromone in ACO"};
+const argument_format af_dmode      = {"-dm", "--distmode", 1, "Set distance storage {auto, dense, packed, sparse, quant16}"};
+const argument_format af_nbrs       = {"-nn", "--neighbours", 1, "Set nearest neighbour count"};
+const argument_format af_gran       = {"-gs", "--granular", 1, "Set savings kept per node in ACO (0 for all pairs)"};
+const argument_format af_intra      = {"-im", "--intramode", 1, "Set intra-route optimizer in ACO {twoopt, or3opt}"};
+const argument_format af_memo       = {"-rm", "--routememo", 1, "Set optimised routes remembered in ACO (0 for none)"};
+const argument_format af_hk         = {"-hk", "--heldkarp", 1, "Set customers up to which routes are ordered exactly in ACO"};
+const argument_format af_islands    = {"-il", "--islands", 1, "Set ACO colonies searched side by side"};
+const argument_format af_migrate    = {"-mg", "--migrate", 1, "Set iterations between migrations of best routes"};
+const argument_format af_topology   = {"-mt", "--migration", 1, "Set islands each island takes routes from {ring, all}"};
+const argument_format af_share      = {"-sh", "--share", 1, "Trade best routes with other processes run with this name"};
+const argument_format af_ckpt       = {"-cp", "--checkpoint", 1, "Set file ACO saves its state to"};
+const argument_format af_ckptsec    = {"-ci", "--checkpointint", 1, "Set seconds between checkpoints"};
+const argument_format af_resume     = {"-re", "--resume", 0, "Resume ACO from the checkpoint, within the same time limit"};
+const argument_format af_stream     = {"-st", "--stream", 1, "Write each better route as found, logging it to this file"};
+const argument_format af_eshare     = {"-es", "--eliteshare", 1, "Set share of ants given local search in ACO (1 for all)"};
+const argument_format af_egap       = {"-eg", "--elitegap", 1, "Also search ants built within this share of the best built"};
 
 
 #define FOREACH_SEARCH_MODE(MACRO) \
@@ -52,7 +77,7 @@ double start_time               = -1;
 String input_file               = DEFAULT_INPUT_FILE;
 String output_file              = DEFAULT_OUTPUT_FILE;
 String data_output_file         = DEFAULT_DATA_OUTPUT_FILE;
-String grid_output_file         = DEFAULT_GRID_OUTPUT_FILE;
+String race_output_file         = DEFAULT_RACE_OUTPUT_FILE;
 Search_Mode search_mode         = MODE_ACO;
 long population_size            = DEFAULT_POPULATION_SIZE;
 long max_stagnancy              = DEFAULT_MAX_STAGNANCY;
@@ -62,10 +87,27 @@ float aco_pers                  = DEFAULT_ACO_PERSISTENCE;
 float aco_min_phero             = DEFAULT_ACO_MIN_PHERO;
 int aco_nbhood_div              = DEFAULT_ACO_NBHOOD_DIV;
 int failure_count               = 0;
-int grid_serach_range[2]        = {0, -1};
 long time_limt_sec              = DEFAULT_TIME_LIMIT_SEC;
-bool do_grid_search             = false;
+String race_file                = "";
 bool use_divine                 = false;
+Dists_Mode dists_mode           = DISTS_AUTO;
+int nbr_count                   = DEFAULT_DISTS_NBRS;
+int aco_granularity             = DEFAULT_ACO_GRANULARITY;
+Intra_Mode aco_intra_mode        = DEFAULT_ACO_INTRA_MODE;
+int route_memo_slots            = DEFAULT_ROUTE_MEMO_SLOTS;
+int aco_held_karp               = DEFAULT_ACO_HELD_KARP;
+int aco_islands                 = DEFAULT_ISLANDS;
+int migration_interval          = DEFAULT_MIGRATION_INTERVAL;
+Migration migration             = MIGRATE_RING;
+String share_name               = "";
+SharedBest *shared_best         = NULL;
+String checkpoint_file          = "";
+int checkpoint_sec              = DEFAULT_CHECKPOINT_SEC;
+bool resume_search              = false;
+String stream_log_file          = "";
+SolutionWriter *solution_writer = NULL;
+float aco_elite_share           = DEFAULT_ACO_ELITE_SHARE;
+float aco_elite_gap             = DEFAULT_ACO_ELITE_GAP;
 Route best_route                = Route::Dummy();
 std::stringstream data_stream;
 
@@ -80,7 +122,7 @@ void print_help_and_exit()
     print_help_arguement(af_help);
     print_help_arguement(af_brand);
     print_help_arguement(af_exc);
-    print_help_arguement(af_grid);
+    print_help_arguement(af_race);
     set_leading_spaces(0);
     raw("       Options:\n");
     set_leading_spaces(8);
@@ -97,11 +139,66 @@ void print_help_and_exit()
     print_help_arguement(af_pers);
     print_help_arguement(af_nbh);
     print_help_arguement(af_mnph);
+    print_help_arguement(af_dmode);
+    print_help_arguement(af_nbrs);
+    print_help_arguement(af_gran);
+    print_help_arguement(af_intra);
+    print_help_arguement(af_memo);
+    print_help_arguement(af_hk);
+    print_help_arguement(af_islands);
+    print_help_arguement(af_migrate);
+    print_help_arguement(af_topology);
+    print_help_arguement(af_share);
+    print_help_arguement(af_ckpt);
+    print_help_arguement(af_ckptsec);
+    print_help_arguement(af_resume);
+    print_help_arguement(af_stream);
+    print_help_arguement(af_eshare);
+    print_help_arguement(af_egap);
     set_leading_spaces(0);
 
     exit(1);
 }
 
+Dists_Mode parse_dists_mode(const char *str)
+{
+    const String name = "DISTS_" + String(str);
+    for (int i = 0; i <= DISTS_QUANT16; i++)
+    {
+        if (strcasecmp(name.c_str(), Dists_Mode_String[i]) == 0)
+            return (Dists_Mode) i;
+    }
+
+    die("Unknown distance mode \"%s\"\n", str);
+    return DISTS_AUTO;
+}
+
+Intra_Mode parse_intra_mode(const char *str)
+{
+    const String name = "INTRA_" + String(str);
+    for (int i = 0; i <= INTRA_OR3OPT; i++)
+    {
+        if (strcasecmp(name.c_str(), Intra_Mode_String[i]) == 0)
+            return (Intra_Mode) i;
+    }
+
+    die("Unknown intra-route mode \"%s\"\n", str);
+    return DEFAULT_ACO_INTRA_MODE;
+}
+
+Migration parse_migration(const char *str)
+{
+    const String name = "MIGRATE_" + String(str);
+    for (int i = 0; i <= MIGRATE_ALL; i++)
+    {
+        if (strcasecmp(name.c_str(), Migration_String[i]) == 0)
+            return (Migration) i;
+    }
+
+    die("Unknown migration topology \"%s\"\n", str);
+    return MIGRATE_RING;
+}
+
 void parse_args(int argc, char *argv[])
 {
     init_args(argc, argv);
@@ -121,11 +218,9 @@ void parse_args(int argc, char *argv[])
         {
             search_mode = MODE_EXCHANGE;
         }
-        else if (next_arg_matches(af_grid))
+        else if (next_arg_matches(af_race))
         {
-            do_grid_search = true;
-            grid_serach_range[0] = parse_long(next_arg());
-            grid_serach_range[1] = parse_long(next_arg());
+            race_file = next_arg();
         }
         else if (next_arg_matches(af_loglv))
         {
@@ -180,6 +275,70 @@ void parse_args(int argc, char *argv[])
         {
             aco_nbhood_div = parse_long(next_arg());
         }
+        else if (next_arg_matches(af_dmode))
+        {
+            dists_mode = parse_dists_mode(next_arg());
+        }
+        else if (next_arg_matches(af_nbrs))
+        {
+            nbr_count = parse_long(next_arg());
+        }
+        else if (next_arg_matches(af_gran))
+        {
+            aco_granularity = parse_long(next_arg());
+        }
+        else if (next_arg_matches(af_intra))
+        {
+            aco_intra_mode = parse_intra_mode(next_arg());
+        }
+        else if (next_arg_matches(af_memo))
+        {
+            route_memo_slots = parse_long(next_arg());
+        }
+        else if (next_arg_matches(af_hk))
+        {
+            aco_held_karp = parse_long(next_arg());
+        }
+        else if (next_arg_matches(af_islands))
+        {
+            aco_islands = parse_long(next_arg());
+        }
+        else if (next_arg_matches(af_migrate))
+        {
+            migration_interval = parse_long(next_arg());
+        }
+        else if (next_arg_matches(af_topology))
+        {
+            migration = parse_migration(next_arg());
+        }
+        else if (next_arg_matches(af_share))
+        {
+            share_name = next_arg();
+        }
+        else if (next_arg_matches(af_ckpt))
+        {
+            checkpoint_file = next_arg();
+        }
+        else if (next_arg_matches(af_ckptsec))
+        {
+            checkpoint_sec = parse_long(next_arg());
+        }
+        else if (next_arg_matches(af_resume))
+        {
+            resume_search = true;
+        }
+        else if (next_arg_matches(af_stream))
+        {
+            stream_log_file = next_arg();
+        }
+        else if (next_arg_matches(af_eshare))
+        {
+            aco_elite_share = parse_float(next_arg());
+        }
+        else if (next_arg_matches(af_egap))
+        {
+            aco_elite_gap = parse_float(next_arg());
+        }
         else
         {
             err("Invalid options (%s)\n", next_arg());
@@ -208,6 +367,25 @@ void writeSolution()
 
 void finalise_and_exit(int default_sig)
 {
+    // Leave the shared segment, removing it if this was the last process.
+    // From a signal handler the search may still be exchanging through
+    // it, so it stays mapped until exit().
+    if (shared_best != NULL && failure_count > 0)
+        shared_best->leave();
+    else
+    {
+        delete shared_best;
+        shared_best = NULL;
+    }
+
+    // Let the writer finish, after which the data file holds the series
+    // so far and what is left in data_stream goes on the end of it. From
+    // a signal handler, the writer is left to exit() if its lock is held.
+    const bool streamed = solution_writer != NULL;
+    if (streamed && (failure_count == 0 || solution_writer->tryStop()))
+        delete solution_writer;
+    solution_writer = NULL;
+
     msg("Time: %.2f s\n", (get_timestamp_us() - start_time) / 1e6);
 
     if (best_route.isDummy())
@@ -222,7 +400,8 @@ void finalise_and_exit(int default_sig)
     {
         msg("Best cost: %.2f\n", best_route.calcScoreSerious());
 
-        writeStrStream(data_output_file, data_stream);
+        writeStrStreamMode(data_output_file, data_stream,
+                           streamed ? std::ios_base::app : std::ios_base::out);
         writeSolution();
 
         exit(default_sig);
@@ -252,6 +431,185 @@ void on_failure(int sig)
     exit(sig);
 }
 
+// Several colonies, each with its own trails and its share of the
+// threads, trading best routes through the islands. Island 0 searches on
+// best_route and writes the data stream; the best of all is kept.
+void run_islands(const Spec& spec, const Dists& dists)
+{
+    const int nIslands = aco_islands;
+    const int nThreads = std::max(1, omp_get_max_threads() / nIslands);
+    msg("Running %d islands of %d threads, migrating every %d iterations (%s)\n",
+        nIslands, nThreads, migration_interval, Migration_String[migration]);
+
+    Islands islands(nIslands, migration, migration_interval);
+    std::vector<Route> bests(nIslands, best_route);
+    std::vector<std::stringstream> streams(nIslands);
+
+    // Islands spread over the places, each one's threads kept close to it
+    omp_set_max_active_levels(2);
+    #pragma omp parallel num_threads(nIslands) proc_bind(spread)
+    {
+        const int island = omp_get_thread_num();
+        omp_set_num_threads(nThreads);
+
+        Ants ants(spec,
+                  dists,
+                  population_size,
+                  max_stagnancy,
+                  aco_alpha,
+                  aco_beta,
+                  aco_pers,
+                  aco_min_phero,
+                  aco_nbhood_div,
+                  aco_granularity,
+                  aco_elite_share,
+                  aco_elite_gap,
+                  aco_intra_mode,
+                  route_memo_slots,
+                  aco_held_karp,
+                  island == 0 ? data_stream : streams[island],
+                  time_limt_sec);
+        ants.joinIslands(islands, island);
+        if (shared_best != NULL)
+            ants.shareBest(*shared_best);
+        if (solution_writer != NULL)
+            ants.streamTo(*solution_writer);
+        ants.search(island == 0 ? best_route : bests[island], start_time);
+    }
+
+    for (int i = 1; i < nIslands; i++)
+        if (bests[i].calcScoreSerious() < best_route.calcScoreSerious())
+            best_route = bests[i];
+}
+
+// Races the configurations in race_file on blocks of one instance and
+// one seed, several runs at once with a share of the threads each. Every
+// run is logged to race_output_file, and the best route found on the main
+// instance is kept in best_route.
+void run_race(const Spec& spec, const Dists& dists)
+{
+    const Contender base = {aco_alpha, aco_beta, aco_pers, aco_min_phero, aco_nbhood_div};
+    Race race(race_file, base);
+
+    const long runSec = race.getSeconds() > 0 ? race.getSeconds() : time_limt_sec;
+    if (runSec == DEFAULT_TIME_LIMIT_SEC)
+        die("Racing needs a time limit, or seconds in the race config\n");
+
+    // The main instance, then the others the config names
+    std::vector<String> files = {input_file};
+    std::vector<const Spec *> instSpecs = {&spec};
+    std::vector<const Dists *> instDists = {&dists};
+    std::deque<Spec> otherSpecs;
+    std::deque<Dists> otherDists;
+    for (const String& file : race.getInstances())
+    {
+        otherSpecs.emplace_back(rand_seed);
+        parse_input(file, otherSpecs.back());
+        otherDists.emplace_back(otherSpecs.back().getNodes(), dists_mode, nbr_count);
+        files.push_back(file);
+        instSpecs.push_back(&otherSpecs.back());
+        instDists.push_back(&otherDists.back());
+    }
+
+    const int nBlocks = race.getSeeds() * files.size();
+    const int slots = race.getSlots() > 0 ? race.getSlots() : omp_get_max_threads();
+    msg("Racing %d configurations on %d instances with %d seeds, %ld s per run\n",
+        (int) race.getContenders().size(), (int) files.size(), race.getSeeds(), runSec);
+
+    std::stringstream header;
+    header << "alpha, beta, pers, minPhero, nbhood, cost, seconds, config, instance, seed\n";
+    writeStrStream(race_output_file, header);
+
+    float bestCost = std::numeric_limits<float>::max();
+    omp_set_max_active_levels(2);
+    for (int block = 0; block < nBlocks && race.getAlive().size() > 1; block++)
+    {
+        // Seeds outer, so that each seed sees every instance before the
+        // next seed starts
+        const int inst = block % files.size();
+        const int seed = rand_seed + block / files.size();
+        const Spec& instSpec = *instSpecs[inst];
+        Spec runSpec(seed);
+        runSpec.setNodes(instSpec.getNodes());
+        runSpec.setDim(instSpec.getDim());
+        runSpec.setSqDim(instSpec.getSqDim());
+        runSpec.setVCap(instSpec.getVCap());
+
+        const Ints alive = race.getAlive();
+        const int nRuns = alive.size();
+        const int nSlots = std::min(slots, nRuns);
+        const int nThreads = std::max(1, omp_get_max_threads() / nSlots);
+        Floats costs(nRuns);
+        std::vector<Ints> hops(nRuns);
+        std::vector<double> runTimes(nRuns);
+
+        #pragma omp parallel for schedule(dynamic) num_threads(nSlots)
+        for (int r = 0; r < nRuns; r++)
+        {
+            omp_set_num_threads(nThreads);
+            const Contender& c = race.getContenders()[alive[r]];
+            const double runStart = get_timestamp_us();
+            std::stringstream runStream;
+            Route route(runSpec.getNodes(), runSpec.getVCap());
+
+            Ants(runSpec,
+                 *instDists[inst],
+                 population_size,
+                 max_stagnancy,
+                 c.alpha,
+                 c.beta,
+                 c.pers,
+                 c.minPhero,
+                 c.nbhood,
+                 aco_granularity,
+                 aco_elite_share,
+                 aco_elite_gap,
+                 aco_intra_mode,
+                 route_memo_slots,
+                 aco_held_karp,
+                 runStream,
+                 runSec).search(route, runStart);
+
+            costs[r] = route.calcScoreSerious();
+            hops[r] = route.getHops();
+            runTimes[r] = (get_timestamp_us() - runStart) / 1e6;
+        }
+
+        std::stringstream race_stream;
+        for (int r = 0; r < nRuns; r++)
+        {
+            const Contender& c = race.getContenders()[alive[r]];
+            race_stream << std::fixed << std::setprecision(2) << c.alpha << ", "
+                        << std::fixed << std::setprecision(2) << c.beta << ", "
+                        << std::fixed << std::setprecision(3) << c.pers << ", "
+                        << std::fixed << std::setprecision(3) << c.minPhero << ", "
+                        << c.nbhood << ", "
+                        << std::fixed << std::setprecision(4) << costs[r] << ", "
+                        << std::fixed << std::setprecision(2) << runTimes[r] << ", "
+                        << alive[r] << ", " << files[inst] << ", " << (unsigned int) seed << "\n";
+
+            if (inst == 0 && costs[r] < bestCost)
+            {
+                bestCost = costs[r];
+                best_route = Route(spec.getNodes(), hops[r], -1);
+            }
+        }
+        writeStrStreamMode(race_output_file, race_stream, std::ios_base::app);
+
+        race.addBlock(costs);
+        const int nDropped = race.eliminate();
+        msg("Race block %d of %d (%s, seed %u): dropped %d, %d configurations left\n",
+            block + 1, nBlocks, files[inst].c_str(), seed, nDropped, (int) race.getAlive().size());
+    }
+
+    const int best = race.getBest();
+    const Contender& c = race.getContenders()[best];
+    msg("Best configuration %d: alpha %.2f, beta %.2f, pers %.3f, minPhero %.3f, nbhood %d "
+        "(mean rank %.2f over %d blocks, %d still in the race)\n",
+        best, c.alpha, c.beta, c.pers, c.minPhero, c.nbhood,
+        race.getMeanRank(best), race.getBlocks(), (int) race.getAlive().size());
+}
+
 int main(int argc, char *argv[])
 {
     if (signal(SIGINT, on_failure) == SIG_ERR ||
@@ -267,6 +625,7 @@ int main(int argc, char *argv[])
     //parse input file
     Spec spec(rand_seed);
     parse_input(input_file, spec);
+    const Dists dists(spec.getNodes(), dists_mode, nbr_count);
 
     best_route = Route(spec.getNodes(), spec.getVCap());
 
@@ -275,106 +634,20 @@ int main(int argc, char *argv[])
     case MODE_BRAND:
     {
         msg("Running basic random search\n");
-        BasicRandom::search(best_route, spec, population_size, data_stream);
+        BasicRandom::search(best_route, spec, dists, population_size, data_stream);
         break;
     }
     case MODE_EXCHANGE:
     {
         msg("Running basic exchange search\n");
-        BasicExchange::search(best_route, spec, data_stream, start_time);
+        BasicExchange::search(best_route, spec, dists, data_stream, start_time);
         break;
     }
     case MODE_ACO:
     {
-        if (do_grid_search)
-        {
-            msg("Running grid search\n");
-            const std::array<std::array<float, 2>, 6> gridAB = {{
-                    {{4.0f, 1.0f}},
-                    {{8.0f, 1.0f}},
-                    {{12.0f, 1.0f}},
-                    {{20.0f, 1.0f}},
-                    {{32.0f, 1.0f}},
-                    {{64.0f, 1.0f}}
-                }
-            };
-            const std::array<float, 6> gridPerss     = {0.83f, 0.85f, 0.87f, 0.98f, 0.99f, 0.995f};
-            const std::array<float, 6> gridMinPheros = {0.00f, 0.005f, 0.01f, 0.015f, 0.02f, 0.025f};
-            const std::array<int, 5> gridNBHoodDivs  = {25, 30, 40, 50, 80};
-
-            const int maxGridIndex = gridAB.size() *
-                                     gridPerss.size() *
-                                     gridMinPheros.size() *
-                                     gridNBHoodDivs.size();
-            if (grid_serach_range[1] == -1 || grid_serach_range[1] > maxGridIndex)
-            {
-                grid_serach_range[1] = maxGridIndex;
-                if (grid_serach_range[1] > maxGridIndex)
-                    wrn("Invalid ending index: % d\n", grid_serach_range[1]);
-            }
-
-            if (grid_serach_range[0] < 0)
-            {
-                grid_serach_range[0] = 0;
-                wrn("Invalid starting index: % d\n", grid_serach_range[0]);
-            }
-
-            for (int gridIndex = grid_serach_range[0];
-                    gridIndex < grid_serach_range[1];
-                    gridIndex++)
-            {
-                int tmp = gridIndex;
-                const int nbhoodIndex = tmp % gridNBHoodDivs.size();
-                const int minPherosIndex = (tmp /= gridNBHoodDivs.size()) %
-                                           gridMinPheros.size();
-                const int perssIndex = (tmp /= gridMinPheros.size()) %
-                                       gridPerss.size();
-                const int abIndex = (tmp /= gridPerss.size()) %
-                                    gridAB.size();
-
-                start_time = get_timestamp_us();
-                Ants(spec,
-                     population_size,
-                     max_stagnancy,
-                     gridAB[abIndex][0],
-                     gridAB[abIndex][1],
-                     gridPerss[perssIndex],
-                     gridMinPheros[minPherosIndex],
-                     gridNBHoodDivs[nbhoodIndex],
-                     data_stream,
-                     time_limt_sec).search(best_route, start_time);
-
-                const float bestCost = best_route.calcScoreSerious();
-                const double antTime = (get_timestamp_us() - start_time) / 1e6;
-                msg("Best cost: % .2f in % .2fs\n", bestCost, antTime);
-                std::stringstream grid_stream;
-                grid_stream << std::fixed << std::setprecision(1) << gridAB[abIndex][0] << ", "
-                            << std::fixed << std::setprecision(1) << gridAB[abIndex][1] << ", "
-                            << std::fixed << std::setprecision(2) << gridPerss[perssIndex] << ", "
-                            << std::fixed << std::setprecision(2) << gridMinPheros[minPherosIndex] << ", "
-                            << gridNBHoodDivs[nbhoodIndex] << ", "
-                            << std::fixed << std::setprecision(16) << bestCost << ", "
-                            << std::fixed << std::setprecision(2) << antTime << ", "
-                            << gridIndex << "\n";
-
-                writeStrStreamMode(grid_output_file, grid_stream, std::ios_base::app);
-                writeStrStream(data_output_file, data_stream);
-                writeSolution();
-            }
-
-            for (const std::array<float, 2> (&AB) : gridAB)
-            {
-                for (const float& pers : gridPerss)
-                {
-                    for (const float& minPhero : gridMinPheros)
-                    {
-                        for (const int& nbhoodDiv : gridNBHoodDivs)
-                        {
-
-                        }
-                    }
-                }
-            }
+        if (!race_file.empty())
+        {
+            run_race(spec, dists);
         }
         else
         {
@@ -387,16 +660,48 @@ int main(int argc, char *argv[])
                 best_route = Route(spec.getNodes(), divineHops, -1);
             }
 
-            Ants(spec,
-                 population_size,
-                 max_stagnancy,
-                 aco_alpha,
-                 aco_beta,
-                 aco_pers,
-                 aco_min_phero,
-                 aco_nbhood_div,
-                 data_stream,
-                 time_limt_sec).search(best_route, start_time);
+            if (!share_name.empty())
+                shared_best = new SharedBest(share_name, spec, migration_interval);
+            if (!stream_log_file.empty())
+                solution_writer = new SolutionWriter(spec.getNodes(),
+                                                     output_file == "stdout" ? "" : output_file,
+                                                     stream_log_file, data_output_file);
+            if (resume_search && checkpoint_file.empty())
+                die("Resuming needs a checkpoint file\n");
+            if (!checkpoint_file.empty() && aco_islands > 1)
+                wrn("Islands do not take checkpoints\n");
+
+            if (aco_islands > 1)
+            {
+                run_islands(spec, dists);
+            }
+            else
+            {
+                Ants ants(spec,
+                          dists,
+                          population_size,
+                          max_stagnancy,
+                          aco_alpha,
+                          aco_beta,
+                          aco_pers,
+                          aco_min_phero,
+                          aco_nbhood_div,
+                          aco_granularity,
+                          aco_elite_share,
+                          aco_elite_gap,
+                          aco_intra_mode,
+                          route_memo_slots,
+                          aco_held_karp,
+                          data_stream,
+                          time_limt_sec);
+                if (shared_best != NULL)
+                    ants.shareBest(*shared_best);
+                if (!checkpoint_file.empty())
+                    ants.checkpointTo(checkpoint_file, checkpoint_sec, resume_search);
+                if (solution_writer != NULL)
+                    ants.streamTo(*solution_writer);
+                ants.search(best_route, start_time);
+            }
         }
         break;
     }
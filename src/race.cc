@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <math.h>
+
+#include "race.h"
+#include "util.h"
+
+// Quantiles of the normal, chi-squared (Wilson-Hilferty) and Student t
+// (Cornish-Fisher) distributions, close enough for deciding a race
+static double normalQuantile(const double p)
+{
+    double lo = -10, hi = 10;
+    for (int i = 0; i < 100; i++)
+    {
+        const double mid = (lo + hi) / 2;
+        if (0.5 * erfc(-mid / sqrt(2.0)) < p)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return (lo + hi) / 2;
+}
+
+static double chiSqQuantile(const double p, const int df)
+{
+    const double z = normalQuantile(p), h = 2.0 / (9.0 * df);
+    return df * pow(1 - h + z * sqrt(h), 3);
+}
+
+static double tQuantile(const double p, const int df)
+{
+    const double z = normalQuantile(p), z3 = z * z * z, z5 = z3 * z * z, z7 = z5 * z * z;
+    const double v = df;
+    return z + (z3 + z) / (4 * v) +
+           (5 * z5 + 16 * z3 + 3 * z) / (96 * v * v) +
+           (3 * z7 + 19 * z5 + 17 * z3 - 15 * z) / (384 * v * v * v);
+}
+
+Race::Race(const String& configFile, const Contender& base)
+    : mySeeds(DEFAULT_RACE_SEEDS), myFirst(DEFAULT_RACE_FIRST), mySlots(0),
+      mySeconds(0), myConfidence(DEFAULT_RACE_CONFIDENCE)
+{
+    std::ifstream is(configFile);
+    if (!is.is_open())
+        die("Can't open race config \"%s\" (%s)\n", configFile.c_str(), get_error_string());
+
+    Floats alphas = {base.alpha}, betas = {base.beta}, perss = {base.pers},
+           minPheros = {base.minPhero};
+    Ints nbhoods = {base.nbhood};
+
+    String line;
+    for (int lineno = 1; std::getline(is, line); lineno++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream ls(line);
+        String key;
+        if (!(ls >> key))
+            continue;
+
+        Floats vals;
+        if (key == "instances")
+        {
+            String file;
+            while (ls >> file)
+                this->myInstances.push_back(file);
+            continue;
+        }
+        for (float v; ls >> v;)
+            vals.push_back(v);
+        if (!ls.eof() || vals.empty())
+            die("Bad values for \"%s\" on line %d of \"%s\"\n", key.c_str(), lineno, configFile.c_str());
+
+        if (key == "alpha")
+            alphas = vals;
+        else if (key == "beta")
+            betas = vals;
+        else if (key == "pers")
+            perss = vals;
+        else if (key == "minphero")
+            minPheros = vals;
+        else if (key == "nbhood")
+            nbhoods = Ints(vals.begin(), vals.end());
+        else if (key == "seeds")
+            this->mySeeds = std::max((int) vals[0], 1);
+        else if (key == "first")
+            this->myFirst = std::max((int) vals[0], 1);
+        else if (key == "confidence")
+            this->myConfidence = vals[0];
+        else if (key == "slots")
+            this->mySlots = std::max((int) vals[0], 0);
+        else if (key == "seconds")
+            this->mySeconds = std::max((long) vals[0], 0L);
+        else
+            die("Unknown key \"%s\" on line %d of \"%s\"\n", key.c_str(), lineno, configFile.c_str());
+    }
+
+    for (const float alpha : alphas)
+        for (const float beta : betas)
+            for (const float pers : perss)
+                for (const float minPhero : minPheros)
+                    for (const int nbhood : nbhoods)
+                        this->myContenders.push_back({alpha, beta, pers, minPhero, nbhood});
+
+    for (int i = 0; i < this->myContenders.size(); i++)
+        this->myAlive.push_back(i);
+}
+
+const std::vector<Contender>& Race::getContenders() const
+{
+    return this->myContenders;
+}
+
+const std::vector<String>& Race::getInstances() const
+{
+    return this->myInstances;
+}
+
+int Race::getSeeds() const
+{
+    return this->mySeeds;
+}
+
+int Race::getSlots() const
+{
+    return this->mySlots;
+}
+
+long Race::getSeconds() const
+{
+    return this->mySeconds;
+}
+
+const Ints& Race::getAlive() const
+{
+    return this->myAlive;
+}
+
+int Race::getBlocks() const
+{
+    return this->myCosts.size();
+}
+
+void Race::addBlock(const Floats& costs)
+{
+    Floats block(this->myContenders.size(), NAN);
+    for (int j = 0; j < this->myAlive.size(); j++)
+        block[this->myAlive[j]] = costs[j];
+    this->myCosts.push_back(block);
+}
+
+// Rank sums of the alive contenders over all blocks, ties sharing the
+// mean of their ranks, and the sum of the squared ranks
+void Race::rankSums(Floats& sums, double& sumSqRanks) const
+{
+    const int k = this->myAlive.size();
+    sums = Floats(k, 0.0f);
+    sumSqRanks = 0;
+
+    Ints order(k);
+    for (const Floats& block : this->myCosts)
+    {
+        for (int j = 0; j < k; j++)
+            order[j] = j;
+        std::sort(order.begin(), order.end(), [&](const int a, const int b)
+        {
+            return block[this->myAlive[a]] < block[this->myAlive[b]];
+        });
+
+        for (int lo = 0, hi; lo < k; lo = hi)
+        {
+            for (hi = lo + 1; hi < k && block[this->myAlive[order[hi]]] ==
+                    block[this->myAlive[order[lo]]]; hi++);
+            const float rank = (lo + hi + 1) / 2.0f;
+            for (int j = lo; j < hi; j++)
+            {
+                sums[order[j]] += rank;
+                sumSqRanks += rank * rank;
+            }
+        }
+    }
+}
+
+int Race::eliminate()
+{
+    const int k = this->myAlive.size(), b = this->myCosts.size();
+    if (k < 2 || b < this->myFirst)
+        return 0;
+
+    Floats sums;
+    double sumSqRanks;
+    rankSums(sums, sumSqRanks);
+
+    // Friedman statistic, in Conover's form that allows for ties
+    const double tieFree = b * k * (k + 1) * (k + 1) / 4.0;
+    const double spread = sumSqRanks - tieFree;
+    if (spread <= 0)
+        return 0;
+
+    double dev = 0;
+    for (const float r : sums)
+        dev += (r - b * (k + 1) / 2.0) * (r - b * (k + 1) / 2.0);
+    const double stat = (k - 1) * dev / spread;
+    if (stat <= chiSqQuantile(this->myConfidence, k - 1))
+        return 0;
+
+    // They differ: drop those whose rank sum is too far above the best's
+    const float bestSum = *std::min_element(sums.begin(), sums.end());
+    const double scale = 2.0 * b * (1 - stat / (b * (k - 1.0))) * spread / ((b - 1.0) * (k - 1.0));
+    const double crit = k == 2 || scale <= 0 ? 0 :
+                        tQuantile(1 - (1 - this->myConfidence) / 2, (b - 1) * (k - 1)) * sqrt(scale);
+
+    Ints alive;
+    for (int j = 0; j < k; j++)
+        if (sums[j] - bestSum <= crit)
+            alive.push_back(this->myAlive[j]);
+
+    const int nDropped = k - alive.size();
+    this->myAlive = alive;
+    return nDropped;
+}
+
+int Race::getBest() const
+{
+    Floats sums;
+    double sumSqRanks;
+    rankSums(sums, sumSqRanks);
+    return this->myAlive[std::min_element(sums.begin(), sums.end()) - sums.begin()];
+}
+
+float Race::getMeanRank(const int contender) const
+{
+    Floats sums;
+    double sumSqRanks;
+    rankSums(sums, sumSqRanks);
+
+    const int j = std::find(this->myAlive.begin(), this->myAlive.end(), contender) -
+                  this->myAlive.begin();
+    return j < this->myAlive.size() && !this->myCosts.empty() ?
+           sums[j] / this->myCosts.size() : NAN;
+}
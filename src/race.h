@@ -0,0 +1,68 @@
+#ifndef _RACE_H_
+#define _RACE_H_
+
+#include <vector>
+
+#include "typedefs.h"
+
+#define DEFAULT_RACE_SEEDS          5       //seeds each configuration is run with per instance
+#define DEFAULT_RACE_FIRST          3       //blocks run before any configuration is dropped
+#define DEFAULT_RACE_CONFIDENCE     0.95f   //confidence a dropped configuration is worse
+
+// ACO parameters a race varies
+typedef struct Contender
+{
+    float alpha, beta, pers, minPhero;
+    int nbhood;
+} Contender;
+
+// A race between ACO configurations, after F-Race. Every configuration
+// still in the race is run on the same block (an instance and a seed);
+// once enough blocks are in, a Friedman test on the ranks within blocks
+// decides whether the configurations differ, and those that rank worse
+// than the best by more than the confidence allows are dropped.
+//
+// The space comes from a file of lines "key value...", '#' starting a
+// comment. alpha, beta, pers, minphero and nbhood list values to try, and
+// every combination is a configuration; a key left out keeps base's
+// value. instances lists files raced on besides the main input, seeds,
+// first and confidence set the race, slots the runs at once (0 for one
+// per core) and seconds the length of each run (0 for the time limit).
+class Race
+{
+public:
+    Race(const String& configFile, const Contender& base);
+    virtual ~Race() {};
+
+    const std::vector<Contender>& getContenders() const;
+    const std::vector<String>& getInstances() const;
+    int getSeeds() const;
+    int getSlots() const;
+    long getSeconds() const;
+
+    // Contenders still in the race, by index
+    const Ints& getAlive() const;
+    int getBlocks() const;
+    // The costs of a block, one per contender alive, in that order
+    void addBlock(const Floats& costs);
+    // Drops what the results so far show to be worse, and how many
+    int eliminate();
+    // Alive contender with the lowest rank sum, and its mean rank
+    int getBest() const;
+    float getMeanRank(const int contender) const;
+
+private:
+    std::vector<Contender> myContenders;
+    std::vector<String> myInstances;
+    int mySeeds, myFirst, mySlots;
+    long mySeconds;
+    float myConfidence;
+
+    Ints myAlive;
+    // Cost of each contender on each block, by block
+    std::vector<Floats> myCosts;
+
+    void rankSums(Floats& sums, double& sumSqRanks) const;
+};
+
+#endif /* include guard */
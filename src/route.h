@@ -31,15 +31,15 @@ public:
     double calcScoreSerious() const;
     bool isDummy();
 
-    template<typename T>
-    T calcScoreWithCache(const Cache<T>& C) const
+    template<typename C>
+    float calcScoreWithCache(const C& cache) const
     {
         const int N = this->myHops.size();
 
-        T score = 0.0f;
+        float score = 0.0f;
         #pragma omp simd
         for (int i = 1; i < N; i++)
-            score += C[this->myHops[i - 1]][this->myHops[i]];
+            score += cache[this->myHops[i - 1]][this->myHops[i]];
 
         return score;
     }
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+
+#include "route_memo.h"
+
+// Fixed, well mixed 64 bits for each node
+static inline uint64_t splitMix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+RouteMemo::RouteMemo(const int dim, const int nSlots)
+    : myNodeHashes(dim), myNodeChecks(dim), mySlots(std::max(nSlots, 0)),
+      myHops((size_t) std::max(nSlots, 0) * ROUTE_MEMO_MAX_HOPS),
+      myShards(NULL), myNShards(nSlots > 0 ? ROUTE_MEMO_SHARDS : 0)
+{
+    for (int i = 0; i < dim; i++)
+    {
+        myNodeHashes[i] = splitMix(2 * i);
+        myNodeChecks[i] = splitMix(2 * i + 1);
+    }
+
+    for (Slot& s : mySlots)
+        s.key.size = 0;
+
+    if (myNShards == 0)
+        return;
+
+    void *p = NULL;
+    if (posix_memalign(&p, CACHE_LINE_BYTES, myNShards * sizeof(Shard)))
+        throw std::bad_alloc();
+    myShards = static_cast<Shard *>(p);
+    for (int i = 0; i < myNShards; i++)
+    {
+        Shard& s = myShards[i];
+        omp_init_lock(&s.lock);
+        s.hits = s.lookups = 0;
+        s.count = 0;
+    }
+}
+
+RouteMemo::~RouteMemo()
+{
+    for (int i = 0; i < myNShards; i++)
+        omp_destroy_lock(&myShards[i].lock);
+    free(myShards);
+}
+
+bool RouteMemo::isEnabled() const
+{
+    return !this->mySlots.empty();
+}
+
+bool RouteMemo::fits(const Ints& hops) const
+{
+    return hops.size() <= ROUTE_MEMO_MAX_HOPS;
+}
+
+RouteMemo::Key RouteMemo::makeKey(const Ints& hops) const
+{
+    Key key = {0, 0, (int) hops.size()};
+    for (int k = 1; k < (int) hops.size() - 1; k++)
+    {
+        key.hash += this->myNodeHashes[hops[k]];
+        key.check += this->myNodeChecks[hops[k]];
+    }
+    return key;
+}
+
+inline RouteMemo::Shard& RouteMemo::shardOf(const size_t slot)
+{
+    return this->myShards[slot % ROUTE_MEMO_SHARDS];
+}
+
+bool RouteMemo::find(const Key& key, Ints& hops, float& cost)
+{
+    const size_t at = key.hash % this->mySlots.size();
+    const Slot& slot = this->mySlots[at];
+    Shard& shard = shardOf(at);
+
+    omp_set_lock(&shard.lock);
+    shard.lookups++;
+    const bool hit = slot.key.hash == key.hash && slot.key.check == key.check &&
+                     slot.key.size == key.size;
+    if (hit)
+    {
+        // The same set, so the same size as hops already is
+        shard.hits++;
+        const int *stored = &this->myHops[at * ROUTE_MEMO_MAX_HOPS];
+        hops.assign(stored, stored + key.size);
+        cost = slot.cost;
+    }
+    omp_unset_lock(&shard.lock);
+
+    return hit;
+}
+
+void RouteMemo::store(const Key& key, const Ints& hops, const float cost)
+{
+    const size_t at = key.hash % this->mySlots.size();
+    Slot& slot = this->mySlots[at];
+    Shard& shard = shardOf(at);
+
+    omp_set_lock(&shard.lock);
+    const bool same = slot.key.hash == key.hash && slot.key.check == key.check &&
+                      slot.key.size == key.size;
+    if (!same || cost < slot.cost)
+    {
+        shard.count += slot.key.size == 0;
+        slot.key = key;
+        slot.cost = cost;
+        std::copy(hops.begin(), hops.end(), &this->myHops[at * ROUTE_MEMO_MAX_HOPS]);
+    }
+    omp_unset_lock(&shard.lock);
+}
+
+long RouteMemo::getHits() const
+{
+    long hits = 0;
+    for (int i = 0; i < this->myNShards; i++)
+        hits += this->myShards[i].hits;
+    return hits;
+}
+
+long RouteMemo::getLookups() const
+{
+    long lookups = 0;
+    for (int i = 0; i < this->myNShards; i++)
+        lookups += this->myShards[i].lookups;
+    return lookups;
+}
+
+int RouteMemo::getCount() const
+{
+    int count = 0;
+    for (int i = 0; i < this->myNShards; i++)
+        count += this->myShards[i].count;
+    return count;
+}
+
+int RouteMemo::getSlots() const
+{
+    return this->mySlots.size();
+}
+
+size_t RouteMemo::bytes() const
+{
+    return this->mySlots.size() * sizeof(Slot) + this->myHops.size() * sizeof(int) +
+           this->myNShards * sizeof(Shard) +
+           (this->myNodeHashes.size() + this->myNodeChecks.size()) * sizeof(uint64_t);
+}
@@ -0,0 +1,79 @@
+#ifndef _ROUTE_MEMO_H_
+#define _ROUTE_MEMO_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "config.h"
+#include "typedefs.h"
+#include "omp.h"
+
+#define DEFAULT_ROUTE_MEMO_SLOTS    65536   //routes remembered, 0 for none
+#define ROUTE_MEMO_SHARDS           64      //locks the slots are split between
+#define ROUTE_MEMO_MAX_HOPS         64      //longest route remembered, depots included
+
+// Optimised orderings of routes, keyed by the set of customers they visit,
+// shared by all threads. A fixed number of slots is split into shards,
+// each behind its own lock. A slot holds one route and is taken over by
+// the next different set that lands on it. Routes are kept in a slab of
+// ROUTE_MEMO_MAX_HOPS per slot, set aside up front so that the ants never
+// allocate through the memo; longer routes are not remembered.
+class RouteMemo
+{
+public:
+    // Two independent hashes of the customer set and its size. Both
+    // hashes are sums, so neither depends on the order of the customers.
+    typedef struct Key
+    {
+        uint64_t hash, check;
+        int size;
+    } Key;
+
+    RouteMemo(const int dim, const int nSlots);
+    virtual ~RouteMemo();
+
+    bool isEnabled() const;
+    // Whether hops is short enough to be remembered
+    bool fits(const Ints& hops) const;
+    Key makeKey(const Ints& hops) const;
+
+    // The ordering and cost stored for key into hops and cost, or false
+    bool find(const Key& key, Ints& hops, float& cost);
+    // Kept unless the slot holds the same set at a lower cost
+    void store(const Key& key, const Ints& hops, const float cost);
+
+    long getHits() const;
+    long getLookups() const;
+    int getCount() const;
+    int getSlots() const;
+    size_t bytes() const;
+
+private:
+    typedef struct Slot
+    {
+        Key key;
+        float cost;
+    } Slot;
+
+    // A cache line each, as every lookup writes its shard's counters
+    typedef struct alignas(CACHE_LINE_BYTES) Shard
+    {
+        omp_lock_t lock;
+        long hits, lookups;
+        int count;
+    } Shard;
+
+    std::vector<uint64_t> myNodeHashes, myNodeChecks;
+    std::vector<Slot> mySlots;
+    // Hops of slot i from i * ROUTE_MEMO_MAX_HOPS, its key's size long
+    Ints myHops;
+    Shard *myShards;
+    int myNShards;
+
+    inline Shard& shardOf(const size_t slot);
+
+    RouteMemo(const RouteMemo&) = delete;
+    RouteMemo& operator=(const RouteMemo&) = delete;
+};
+
+#endif /* include guard */
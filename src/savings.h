@@ -2,9 +2,14 @@
 #define _SAVINGS_H_
 
 #include <algorithm>
+#if defined(_OPENMP) && defined(__GLIBCXX__)
+#include <parallel/algorithm>
+#endif
 
 #include "score.h"
 #include "cache.h"
+#include "dists.h"
+#include "omp.h"
 
 #define GAIN_THRESOLD   1.0f //ignore gains below this number
 
@@ -17,51 +22,141 @@ struct Saving
     float gain;
     Saving(const int n1val, const int n2val, const float gainVal)
         : n1(n1val), n2(n2val), gain(gainVal) {};
+    Saving() : n1(0), n2(0), gain(0.0f) {};
+
+    // Ties broken on ids so the order does not depend on thread count
     bool operator < (const Saving& sv) const
     {
-        return (gain > sv.gain);
+        if (gain != sv.gain)
+            return (gain > sv.gain);
+        return n1 != sv.n1 ? n1 < sv.n1 : n2 < sv.n2;
     }
 };
 using Savings = std::vector<Saving>;
 
-template<typename T>
-Savings makeSavings(const Cache<T>& dists)
+// Concatenate per-thread buffers, normalise gains so that they are
+// comparable to pheromone [0~1], and sort by descending gain
+inline Savings gatherSavings(std::vector<Savings>& parts)
 {
-    const int N = dists[0].size();
+    std::vector<size_t> offsets(parts.size() + 1, 0);
+    for (int t = 0; t < parts.size(); t++)
+        offsets[t + 1] = offsets[t] + parts[t].size();
+
+    Savings S(offsets.back());
+
+    #pragma omp parallel for
+    for (int t = 0; t < parts.size(); t++)
+    {
+        std::copy(parts[t].begin(), parts[t].end(), S.begin() + offsets[t]);
+        Savings().swap(parts[t]);
+    }
 
-    Savings S;
-    S.reserve(N * N / 2);
+#if defined(_OPENMP) && defined(__GLIBCXX__)
+    __gnu_parallel::sort(S.begin(), S.end());
+#else
+    std::sort(S.begin(), S.end());
+#endif
 
+    // Summed after sorting so the total is the same for any thread count
     float sumGains = 0.0f;
-    for (int i = 1; i < N; i++)
-        for (int j = i + 1; j < N; j++)
+    for (const Saving &s : S)
+        sumGains += s.gain;
+
+    #pragma omp parallel for
+    for (size_t i = 0; i < S.size(); i++)
+        S[i].gain /= sumGains;
+
+    return S;
+}
+
+template<typename D>
+Savings makeSavings(const D& dists)
+{
+    const int N = dists.size();
+
+    std::vector<Savings> parts(omp_get_max_threads());
+
+    #pragma omp parallel
+    {
+        Savings& local = parts[omp_get_thread_num()];
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int i = 1; i < N; i++)
+            for (int j = i + 1; j < N; j++)
+            {
+                const float gain = (dists[i][0] + dists[j][0] - dists[i][j]);
+                if (gain > GAIN_THRESOLD)
+                    local.push_back(Saving(i, j, gain));
+            }
+    }
+
+    return gatherSavings(parts);
+}
+
+// Granular variant: each node keeps only its best k savings among its
+// nearest neighbours, so the list is O(kN) instead of O(N^2). A pair is
+// kept if it is in the top k of either end.
+inline Savings makeGranularSavings(const Dists& dists, const int k)
+{
+    const int N = dists.size();
+    const int K = dists.getNbrCount();
+    const int G = std::max(1, std::min(k, K));
+
+    Ints top((size_t) N * G, -1);
+
+    #pragma omp parallel
+    {
+        Savings cands;
+        cands.reserve(K);
+
+        #pragma omp for schedule(dynamic, 64)
+        for (int i = 1; i < N; i++)
         {
-            const float gain = (dists[i][0] + dists[j][0] - dists[i][j]);
-            if (gain > GAIN_THRESOLD)
+            cands.clear();
+            const int *nbrs = dists.getNbrs(i);
+            const float *nbrDists = dists.getNbrDists(i);
+            for (int n = 0; n < K; n++)
             {
-                sumGains += gain;
-                S.push_back(Saving(i, j, gain));
+                const int j = nbrs[n];
+                const float gain = (dists[i][0] + dists[j][0] - nbrDists[n]);
+                if (gain > GAIN_THRESOLD)
+                    cands.push_back(Saving(i, j, gain));
             }
+
+            const int nTop = std::min(G, (int) cands.size());
+            std::partial_sort(cands.begin(), cands.begin() + nTop, cands.end());
+            for (int n = 0; n < nTop; n++)
+                top[(size_t) i * G + n] = cands[n].n2;
         }
+    }
 
-    // Normalise gains so that it is comparable to pheromone [0~1]
-    for (Saving &s : S)
-        s.gain /= sumGains;
+    std::vector<Savings> parts(omp_get_max_threads());
 
-    std::sort(S.begin(), S.end());
+    #pragma omp parallel
+    {
+        Savings& local = parts[omp_get_thread_num()];
 
-    // for (int i = 0; i < S.size(); i++)
-    // {
-    //     if (S[i].n1 == 9)
-    //     {
-    //         dbg("[%d] %d->%d: %.2f (own=%.2f, between=%.2f)\n",
-    //             i, S[i].n1, S[i].n2, S[i].gain, dists[S[i].n1][0], dists[S[i].n1][S[i].n2]);
-    //     }
-    // }
-    // die("Here\n");
-    return S;
+        #pragma omp for schedule(dynamic, 64)
+        for (int i = 1; i < N; i++)
+        {
+            for (int n = 0; n < G && top[(size_t) i * G + n] != -1; n++)
+            {
+                const int j = top[(size_t) i * G + n];
+
+                // Pair seen from both sides - keep the one from the smaller id
+                const int *jTop = &top[(size_t) j * G];
+                if (j < i && std::find(jTop, jTop + G, i) != jTop + G)
+                    continue;
+
+                local.push_back(Saving(std::min(i, j), std::max(i, j),
+                                       dists[i][0] + dists[j][0] - dists[i][j]));
+            }
+        }
+    }
+
+    return gatherSavings(parts);
 }
 
 }
 
-#endif /* include guard */
\ No newline at end of file
+#endif /* include guard */
@@ -1,9 +1,123 @@
 #include <cmath>
+#include <algorithm>
 
 #include "score.h"
 
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+#define TRANSPOSE_BLOCK 64
+
 namespace Score
 {
+// Score::real from node i to nodes j0..N-1. Squares are exact in double,
+// so this matches the scalar version bit for bit.
+SIMD_CLONES
+static void realRow(const float *xs, const float *ys,
+                    const int i, const int j0, const int N, float *out)
+{
+    const float xi = xs[i], yi = ys[i];
+
+    #pragma omp simd
+    for (int j = j0; j < N; j++)
+    {
+        const double dx = xs[j] - xi, dy = ys[j] - yi;
+        out[j - j0] = sqrtf((float) (dx * dx + dy * dy));
+    }
+}
+
+static void splitCoords(const Nodes& nodes, Floats& xs, Floats& ys)
+{
+    xs.resize(nodes.size());
+    ys.resize(nodes.size());
+    for (int i = 0; i < nodes.size(); i++)
+    {
+        xs[i] = nodes[i].x;
+        ys[i] = nodes[i].y;
+    }
+}
+
+// Copy the upper triangle into the lower one tile by tile
+template<typename T>
+static void mirrorUpper(Cache<T>& C)
+{
+    const int N = C.size();
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int bi = 0; bi < N; bi += TRANSPOSE_BLOCK)
+        for (int bj = 0; bj <= bi; bj += TRANSPOSE_BLOCK)
+            for (int i = bi; i < std::min(bi + TRANSPOSE_BLOCK, N); i++)
+                for (int j = bj; j < std::min(bj + TRANSPOSE_BLOCK, i); j++)
+                    C[i][j] = C[j][i];
+}
+
+Cache<float> makeRealCache(const Nodes& nodes)
+{
+    const int N = nodes.size();
+    Floats xs, ys;
+    splitCoords(nodes, xs, ys);
+
+    Cache<float> C(N);
+
+    // Upper triangle, one row per iteration
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < N; i++)
+        realRow(xs.data(), ys.data(), i, i, N, C[i] + i);
+
+    mirrorUpper(C);
+
+    return C;
+}
+
+Cache<uint16_t> makeQuantCache(const Nodes& nodes, const float step)
+{
+    const int N = nodes.size();
+    Floats xs, ys;
+    splitCoords(nodes, xs, ys);
+
+    Cache<uint16_t> C(N);
+    const float invStep = 1.0f / step;
+
+    #pragma omp parallel
+    {
+        Floats row(N);
+
+        #pragma omp for schedule(dynamic, 16)
+        for (int i = 0; i < N; i++)
+        {
+            realRow(xs.data(), ys.data(), i, i, N, row.data());
+
+            uint16_t *R = C[i];
+            #pragma omp simd
+            for (int j = i; j < N; j++)
+                R[j] = (uint16_t) std::min(row[j - i] * invStep + 0.5f, (float) UINT16_MAX);
+        }
+    }
+
+    mirrorUpper(C);
+
+    return C;
+}
+
+Floats makeRealTriangle(const Nodes& nodes)
+{
+    const int N = nodes.size();
+    Floats xs, ys;
+    splitCoords(nodes, xs, ys);
+
+    Floats T((size_t) N * (N + 1) / 2);
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = 0; i < N; i++)
+        realRow(xs.data(), ys.data(), i, i, N,
+                &T[(size_t) i * N - (size_t) i * (i - 1) / 2]);
+
+    return T;
+}
+
 double serious(const Node& p1, const Node& p2)
 {
     return sqrt(pow((double) p2.x - (double) p1.x, 2) + pow((double) p2.y - (double) p1.y, 2));
@@ -1,6 +1,8 @@
 #ifndef _SCORE_H_
 #define _SCORE_H_
 
+#include <stdint.h>
+
 #include "typedefs.h"
 #include "node.h"
 #include "cache.h"
@@ -14,22 +16,26 @@ float real(const Node& p1, const Node& p2);
 float inv(const Node& p1, const Node& p2);
 float fast(const Node& p1, const Node& p2);
 
+// Score::real for every pair, each computed once, in parallel
+Cache<float> makeRealCache(const Nodes& nodes);
+
+// Packed upper triangle of makeRealCache - row i holds columns i..N-1
+Floats makeRealTriangle(const Nodes& nodes);
+
+// makeRealCache rounded to multiples of step
+Cache<uint16_t> makeQuantCache(const Nodes& nodes, const float step);
+
 template<typename T>
 Cache<T> makeScoreCache(const Nodes& nodes, T (*scoreFunc)(const Node&, const Node&))
 {
     const int N = nodes.size();
 
-    Cache<T> C;
-    C.reserve(N);
+    Cache<T> C(N, 0);
     for (int i = 0; i < N; i++)
     {
-        CacheRow<T> R;
-        R.reserve(N);
-
+        T *R = C[i];
         for (int j = 0; j < N; j++)
-            R.push_back(scoreFunc(nodes[i], nodes[j]));
-
-        C.push_back(R);
+            R[j] = scoreFunc(nodes[i], nodes[j]);
     }
 
     return C;
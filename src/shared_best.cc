@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shared_best.h"
+#include "util.h"
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "shared memory needs address-free atomics");
+
+static const uint64_t SEGMENT_MAGIC = 0x6a616e7473626573ULL;
+
+SharedBest::SharedBest(const String& name, const Spec& spec, const int interval)
+    : myName("/jants-" + name), myInterval(std::max(interval, 1)),
+      mySeg(NULL), myHops(NULL), myBytes(0), myLeft(false)
+{
+    // A route visits every customer once and the depot between routes
+    const int capacity = 2 * spec.getDim() + 1;
+    if (attach(spec.fingerprint(), capacity))
+        msg("Sharing best routes through %s\n", this->myName.c_str());
+}
+
+SharedBest::~SharedBest()
+{
+    if (this->mySeg == NULL)
+        return;
+
+    leave();
+    munmap(this->mySeg, this->myBytes);
+}
+
+void SharedBest::leave()
+{
+    if (this->mySeg == NULL || this->myLeft)
+        return;
+    this->myLeft = true;
+
+    // The last process out removes the segment
+    if (this->mySeg->users.fetch_sub(1) == 1)
+        shm_unlink(this->myName.c_str());
+}
+
+bool SharedBest::isEnabled() const
+{
+    return this->mySeg != NULL;
+}
+
+int SharedBest::getInterval() const
+{
+    return this->myInterval;
+}
+
+bool SharedBest::attach(const uint64_t key, const int capacity)
+{
+    const size_t bytes = sizeof(Segment) + capacity * sizeof(int);
+    const char *name = this->myName.c_str();
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    const bool creator = fd >= 0;
+    if (!creator)
+    {
+        if (errno == EEXIST)
+            fd = shm_open(name, O_RDWR, 0600);
+        if (fd < 0)
+        {
+            wrn("Cannot open shared memory %s: %s\n", name, strerror(errno));
+            return false;
+        }
+    }
+
+    if (creator)
+    {
+        if (ftruncate(fd, bytes) != 0)
+        {
+            wrn("Cannot size shared memory %s: %s\n", name, strerror(errno));
+            close(fd);
+            shm_unlink(name);
+            return false;
+        }
+    }
+    else
+    {
+        // The creator may not have sized it yet
+        struct stat st;
+        for (int ms = 0; fstat(fd, &st) == 0 && st.st_size == 0 && ms < SHARED_BEST_ATTACH_MS; ms++)
+            usleep(1000);
+        if (st.st_size != (off_t) bytes)
+        {
+            wrn("Shared memory %s is in use for another instance\n", name);
+            close(fd);
+            return false;
+        }
+    }
+
+    void *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+    {
+        wrn("Cannot map shared memory %s: %s\n", name, strerror(errno));
+        if (creator)
+            shm_unlink(name);
+        return false;
+    }
+
+    Segment *seg;
+    if (creator)
+    {
+        seg = new (mem) Segment;
+        seg->key = key;
+        seg->capacity = capacity;
+        seg->users.store(0);
+        seg->seq.store(0);
+        seg->score.store(std::numeric_limits<float>::max());
+        seg->len = 0;
+        seg->ready.store(SEGMENT_MAGIC, std::memory_order_release);
+    }
+    else
+    {
+        seg = (Segment *) mem;
+        for (int ms = 0; seg->ready.load(std::memory_order_acquire) != SEGMENT_MAGIC &&
+                ms < SHARED_BEST_ATTACH_MS; ms++)
+            usleep(1000);
+        if (seg->ready.load(std::memory_order_acquire) != SEGMENT_MAGIC ||
+                seg->key != key || seg->capacity != capacity)
+        {
+            wrn("Shared memory %s is in use for another instance\n", name);
+            munmap(mem, bytes);
+            return false;
+        }
+    }
+
+    seg->users.fetch_add(1);
+    this->mySeg = seg;
+    this->myHops = (int *) (seg + 1);
+    this->myBytes = bytes;
+    return true;
+}
+
+bool SharedBest::exchange(const Ints& hops, const float score, Ints& inHops, float& inScore)
+{
+    Segment& seg = *this->mySeg;
+
+    // Post: take the odd sequence, or leave it to whoever holds it
+    uint64_t seq = seg.seq.load(std::memory_order_relaxed);
+    if (score < seg.score.load(std::memory_order_relaxed) && (seq & 1) == 0 &&
+            (int) hops.size() <= seg.capacity &&
+            seg.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_relaxed))
+    {
+        std::atomic_thread_fence(std::memory_order_release);
+        if (score < seg.score.load(std::memory_order_relaxed))
+        {
+            seg.len = hops.size();
+            std::copy(hops.begin(), hops.end(), this->myHops);
+            seg.score.store(score, std::memory_order_relaxed);
+        }
+        seg.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Fetch: a copy counts only if no write began or ended during it
+    inScore = score;
+    for (int t = 0; t < SHARED_BEST_READ_TRIES; t++)
+    {
+        const uint64_t before = seg.seq.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+
+        const float shared = seg.score.load(std::memory_order_relaxed);
+        if (shared >= score)
+            return false;
+
+        const int len = std::min(std::max(seg.len, 0), seg.capacity);
+        inHops.assign(this->myHops, this->myHops + len);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seg.seq.load(std::memory_order_relaxed) == before)
+        {
+            inScore = shared;
+            return true;
+        }
+    }
+
+    return false;
+}
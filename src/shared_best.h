@@ -0,0 +1,65 @@
+#ifndef _SHARED_BEST_H_
+#define _SHARED_BEST_H_
+
+#include <atomic>
+#include <stdint.h>
+
+#include "typedefs.h"
+#include "spec.h"
+
+#define SHARED_BEST_READ_TRIES      8       //reads of a changing segment before giving up
+#define SHARED_BEST_ATTACH_MS       2000    //wait for another process to set a segment up
+
+// Best route of every jants process on this host solving the same
+// instance, in a POSIX shared memory segment named after the run. Writes
+// go under a sequence lock: a writer makes the sequence odd, copies the
+// route in and makes it even again, and a reader keeps a copy only if the
+// sequence was the same even number before and after. No process ever
+// blocks: a writer that finds another one writing skips its turn, and a
+// reader that keeps catching writes gives up until next time. A process
+// killed mid-write leaves the sequence odd, which stops the trading until
+// the segment is removed from /dev/shm.
+class SharedBest
+{
+public:
+    // Joins the segment called name, creating it if it is not there. The
+    // instance is fingerprinted so processes on different instances do
+    // not trade routes; a mismatch leaves sharing disabled.
+    SharedBest(const String& name, const Spec& spec, const int interval);
+    virtual ~SharedBest();
+
+    bool isEnabled() const;
+    int getInterval() const;
+
+    // Posts hops if score beats the shared best, and fetches the shared
+    // best into inHops if it beats score
+    bool exchange(const Ints& hops, const float score, Ints& inHops, float& inScore);
+    // Gives up this process's share of the segment, removing it if no
+    // other process uses it, but keeps it mapped: from a signal handler,
+    // search threads may still be in exchange
+    void leave();
+
+private:
+    typedef struct Segment
+    {
+        std::atomic<uint64_t> ready;    //magic once the creator is done
+        uint64_t key;                   //instance fingerprint
+        int capacity;                   //most hops a route can have
+        std::atomic<int> users;
+        std::atomic<uint64_t> seq;
+        std::atomic<float> score;
+        int len;
+        //followed by capacity hops
+    } Segment;
+
+    const String myName;
+    const int myInterval;
+    Segment *mySeg;
+    int *myHops;
+    size_t myBytes;
+    bool myLeft;
+
+    bool attach(const uint64_t key, const int capacity);
+};
+
+#endif /* include guard */
@@ -0,0 +1,141 @@
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdio.h>
+#include <time.h>
+
+#include "solution_writer.h"
+#include "output_writer.h"
+#include "route.h"
+#include "util.h"
+
+SolutionWriter::SolutionWriter(const Nodes& nodes, const String& solutionFile,
+                               const String& logFile, const String& dataFile)
+    : myNodes(nodes), mySolutionFile(solutionFile), myLogFile(logFile), myDataFile(dataFile),
+      myStopping(false), myHasRoute(false), myBestPosted(std::numeric_limits<float>::max())
+{
+    // Both grow from nothing for this run
+    std::ofstream(this->myLogFile, std::ios_base::trunc);
+    std::ofstream(this->myDataFile, std::ios_base::trunc);
+
+    this->myThread = std::thread(&SolutionWriter::run, this);
+}
+
+SolutionWriter::~SolutionWriter()
+{
+    stop();
+}
+
+void SolutionWriter::post(const Ints& hops, const float cost, const int itr, const double secElapsed)
+{
+    char line[96];
+    snprintf(line, sizeof(line), "%ld, %.4f, %d, %.4f\n",
+             (long) time(NULL), secElapsed, itr, cost);
+
+    {
+        std::lock_guard<std::mutex> guard(this->myLock);
+        if (cost >= this->myBestPosted)
+            return;
+        this->myBestPosted = cost;
+        this->myHops.assign(hops.begin(), hops.end());
+        this->myHasRoute = true;
+        this->myLogLines += line;
+    }
+    this->myWake.notify_one();
+}
+
+void SolutionWriter::appendData(const String& lines)
+{
+    {
+        std::lock_guard<std::mutex> guard(this->myLock);
+        this->myData += lines;
+    }
+    this->myWake.notify_one();
+}
+
+void SolutionWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(this->myLock);
+        this->myStopping = true;
+    }
+    this->myWake.notify_one();
+
+    if (this->myThread.joinable())
+        this->myThread.join();
+}
+
+bool SolutionWriter::tryStop()
+{
+    // The signal may also have landed on the writer itself
+    if (std::this_thread::get_id() == this->myThread.get_id() || !this->myLock.try_lock())
+        return false;
+    this->myStopping = true;
+    this->myLock.unlock();
+    this->myWake.notify_one();
+
+    if (this->myThread.joinable())
+        this->myThread.join();
+    return true;
+}
+
+void SolutionWriter::run()
+{
+    Ints hops;
+    String logLines, data;
+
+    std::unique_lock<std::mutex> guard(this->myLock);
+    while (true)
+    {
+        this->myWake.wait(guard, [this]()
+        {
+            return this->myStopping || this->myHasRoute ||
+                   !this->myLogLines.empty() || !this->myData.empty();
+        });
+
+        // Take what is queued and write it with the lock released
+        const bool hasRoute = this->myHasRoute;
+        if (hasRoute)
+            hops.swap(this->myHops);
+        this->myHasRoute = false;
+        logLines.swap(this->myLogLines);
+        data.swap(this->myData);
+        const bool stopping = this->myStopping;
+        guard.unlock();
+
+        if (hasRoute && !this->mySolutionFile.empty())
+            writeSolution(hops);
+        if (!logLines.empty())
+            append(this->myLogFile, logLines);
+        if (!data.empty())
+            append(this->myDataFile, data);
+        logLines.clear();
+        data.clear();
+
+        guard.lock();
+        if (stopping && !this->myHasRoute && this->myLogLines.empty() && this->myData.empty())
+            break;
+    }
+}
+
+void SolutionWriter::writeSolution(const Ints& hops)
+{
+    std::stringstream ss;
+    solutionToStrStream(this->mySolutionFile, Route(this->myNodes, hops, -1), ss);
+
+    const String tmpFile = this->mySolutionFile + ".tmp";
+    std::ofstream os(tmpFile);
+    os << ss.rdbuf();
+    os.close();
+    if (os.fail() || rename(tmpFile.c_str(), this->mySolutionFile.c_str()) != 0)
+        wrn("Can't write solution \"%s\" (%s)\n", this->mySolutionFile.c_str(), get_error_string());
+}
+
+void SolutionWriter::append(const String& file, const String& text)
+{
+    std::ofstream os(file, std::ios_base::app);
+    os << text;
+    os.close();
+    if (os.fail())
+        wrn("Can't append to \"%s\" (%s)\n", file.c_str(), get_error_string());
+}
@@ -0,0 +1,55 @@
+#ifndef _SOLUTION_WRITER_H_
+#define _SOLUTION_WRITER_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "typedefs.h"
+#include "node.h"
+
+// Writes each better route as soon as it is found, from a thread of its
+// own so the search never waits on the disk. The solution file is
+// replaced whole through a rename, so a reader always finds a complete
+// solution, and every improvement is appended to a log as
+// "unix time, seconds in, iteration, cost". The search's data series is
+// handed over as it grows rather than kept until exit.
+class SolutionWriter
+{
+public:
+    // No solution file is written if solutionFile is empty
+    SolutionWriter(const Nodes& nodes, const String& solutionFile,
+                   const String& logFile, const String& dataFile);
+    virtual ~SolutionWriter();
+
+    // Queues hops if they beat everything posted so far. Only the latest
+    // route is kept for the solution file, but each is logged.
+    void post(const Ints& hops, const float cost, const int itr, const double secElapsed);
+    void appendData(const String& lines);
+    // Writes what is queued and ends the thread
+    void stop();
+    // stop for signal handlers: false, leaving the thread be, if the lock
+    // is taken, as its holder may be the code the signal interrupted
+    bool tryStop();
+
+private:
+    const Nodes& myNodes;
+    const String mySolutionFile, myLogFile, myDataFile;
+
+    std::mutex myLock;
+    std::condition_variable myWake;
+    std::thread myThread;
+    bool myStopping;
+
+    // Queued under myLock
+    bool myHasRoute;
+    Ints myHops;
+    float myBestPosted;
+    String myLogLines, myData;
+
+    void run();
+    void writeSolution(const Ints& hops);
+    void append(const String& file, const String& text);
+};
+
+#endif /* include guard */
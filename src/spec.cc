@@ -53,3 +53,24 @@ void Spec::setVCap(const int val)
 {
     this->vCap = val;
 }
+
+uint64_t Spec::fingerprint() const
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto mix = [&h](const void *data, const size_t size)
+    {
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < size; i++)
+            h = (h ^ bytes[i]) * 0x100000001b3ULL;
+    };
+
+    mix(&this->dim, sizeof(this->dim));
+    mix(&this->vCap, sizeof(this->vCap));
+    for (const Node& n : this->nodes)
+    {
+        mix(&n.x, sizeof(n.x));
+        mix(&n.y, sizeof(n.y));
+        mix(&n.z, sizeof(n.z));
+    }
+    return h;
+}
@@ -1,6 +1,8 @@
 #ifndef _SPEC_H_
 #define _SPEC_H_
 
+#include <stdint.h>
+
 #include "typedefs.h"
 #include "node.h"
 
@@ -20,6 +22,8 @@ public:
     void setSqDim(const int val);
     int getVCap() const;
     void setVCap(const int val);
+    // Hash of the instance, to tell whether two runs solve the same one
+    uint64_t fingerprint() const;
 private:
     Nodes nodes;
     bool nodesSet = false;